@@ -12,19 +12,64 @@ size_t xultoa(unsigned long value, char *dst);
 size_t xltoa(long value, char *dst);
 size_t xint_len(size_t value);
 
+size_t xulltoa(unsigned long long value, char *dst);
+size_t xlltoa(long long value, char *dst);
+size_t xint_len64(uint64_t value);
+
+#if defined(__SIZEOF_INT128__)
+size_t xu128toa(unsigned __int128 value, char *dst);
+size_t xi128toa(__int128 value, char *dst);
+#endif
+
 char *xftoa(double f, char *buf, int precision);
 
+/* shortest round-trip output, dst must hold XDTOA_SHORTEST_BUFSIZE bytes */
+#define XDTOA_SHORTEST_BUFSIZE 26
+size_t xdtoa_shortest(double val, char *dst);
+size_t xftoa_shortest(float val, char *dst);
+
 char *xdtostrf_b(double val, const int8_t width, const uint8_t prec, char *sout, const uint8_t pad_digit);
 char *xdtostrf(double val, const int8_t width, const uint8_t prec, char *sout);
 
 size_t int_to_char(int32_t f, char *str);
 size_t uint_to_char(uint32_t f, char *str);
+/* integer scaled by 10^-prec (0..9), fix_to_char(471234567, 7, s) is 47.1234567 */
+size_t fix_to_char(int32_t v, uint8_t prec, char *str);
+size_t ufix_to_char(uint32_t v, uint8_t prec, char *str);
 
 size_t time_to_char_hm(int16_t h, int16_t m, char *str);
 size_t time_to_char_hms(uint8_t h, uint8_t m, uint8_t s, char *str);
 size_t date_to_char(int16_t d, int16_t m, int16_t y, uint8_t format, char *str);
+/* HH:MM:SS, hours widen past 99 */
 size_t sec_to_hms_str(uint32_t sec, char *str);
 
+/* [D:]HH:MM:SS[.mmm] of a duration in ms, hours widen past 99 unless days
+ * are split off, str must hold DURATION_BUFSIZE bytes, returns the length */
+#define DURATION_DAYS 0x01 /* leading days field, hours stay below 24 */
+#define DURATION_MS 0x02   /* three fraction digits */
+#define DURATION_BUFSIZE 26
+size_t duration_to_str(uint64_t ms, uint8_t flags, char *str);
+
+/* last rendered YYYY-MM-DDTHH:MM:SS.mmm, an update redraws only the fields
+ * that changed, append it with strbf_put(sb, c.buf, TS_CACHE_LEN) */
+#define TS_CACHE_LEN 23
+typedef struct ts_cache_s {
+    char buf[TS_CACHE_LEN + 1];
+    uint16_t y, ms;
+    uint8_t mo, d, h, mi, s;
+} ts_cache_t;
+void ts_cache_init(ts_cache_t *c);
+const char *ts_cache_update(ts_cache_t *c, uint16_t y, uint8_t mo, uint8_t d, uint8_t h, uint8_t mi, uint8_t s, uint16_t ms);
+
+/* RFC 3339 time of ms since the epoch, YYYY-MM-DDTHH:MM:SS.mmm followed by Z
+ * or the offset as +HH:MM, the time is shifted by tz_offset_min (-1439..1439).
+ * The _p variant takes t in units of 10^-prec seconds and writes prec (0..9)
+ * fraction digits. Years outside 0..9999 get a sign. out must hold
+ * ISO8601_BUFSIZE bytes, returns the length. */
+#define ISO8601_BUFSIZE 48
+size_t epoch_to_iso8601(int64_t ms, int tz_offset_min, char *out);
+size_t epoch_to_iso8601_p(int64_t t, uint8_t prec, int tz_offset_min, char *out);
+
 size_t f_to_char_f(double f, char *str, uint8_t fractionlen, uint8_t padlen);
 size_t f_to_char(double f, char *str, uint8_t fractionlength);
 size_t f1_to_char(double f, char *str);
@@ -33,6 +78,16 @@ size_t f3_to_char(double f, char *str);
 
 size_t concat(char *dst, size_t dlen, const char *src, size_t len);
 
+/* parse at most len bytes, returns bytes consumed or 0 on no digits / overflow */
+size_t xatoul(const char *s, size_t len, uint64_t *out);
+size_t xatol(const char *s, size_t len, int64_t *out);
+/* exactly 2, 4 or 8 digits, returns the width or 0 if any byte is not a digit */
+size_t xatou2(const char *s, uint32_t *out);
+size_t xatou4(const char *s, uint32_t *out);
+size_t xatou8(const char *s, uint32_t *out);
+/* parse a decimal double from at most len bytes, returns bytes consumed or 0 */
+size_t xstrtod(const char *s, size_t len, double *out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,17 +6,198 @@ extern "C" {
 #endif
 
 #include <ctype.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 
 #define SB strbf_t
+
+/* inline bytes of strbf_sso_t, content + terminating 0 */
+#ifndef STRBF_SSO_SIZE
+#define STRBF_SSO_SIZE 48
+#endif
+
+/* separator offsets kept by strbf_path_t, older ones are dropped */
+#ifndef STRBF_PATH_DEPTH
+#define STRBF_PATH_DEPTH 32
+#endif
+
+/* no match, from strbf_find and friends */
+#define STRBF_NPOS ((size_t)-1)
+
+    /* allocator, sizes include the terminating 0, ctx is passed back */
+    typedef struct strbf_alloc_s {
+        void * (*alloc)(void *ctx, size_t size);
+        void * (*realloc)(void *ctx, void *ptr, size_t old_size, size_t size);
+        void (*free)(void *ctx, void *ptr, size_t size);
+        void * ctx;
+    } strbf_alloc_t;
+
+    /* bump pointer arena over caller memory, freed all at once by reset */
+    typedef struct strbf_arena_s {
+        char * base;
+        size_t size;
+        size_t used;
+        strbf_alloc_t alloc;
+    } strbf_arena_t;
+
+/* ops in a compiled format, literal runs count too */
+#ifndef STRBF_FMT_MAX_OPS
+#define STRBF_FMT_MAX_OPS 32
+#endif
+
+/* strbf_fmt_op_t types, the argument each one takes */
+#define STRBF_FMT_LIT 0 /* literal run, no argument */
+#define STRBF_FMT_I   1 /* int, .i */
+#define STRBF_FMT_L   2 /* long, .i */
+#define STRBF_FMT_LL  3 /* long long, .i */
+#define STRBF_FMT_U   4 /* unsigned, .u */
+#define STRBF_FMT_UL  5 /* unsigned long, .u */
+#define STRBF_FMT_ULL 6 /* unsigned long long, .u */
+#define STRBF_FMT_C   7 /* char passed as int, .i */
+#define STRBF_FMT_S   8 /* const char *, .s */
+#define STRBF_FMT_F   9 /* double, .f */
+
+/* strbf_fmt_op_t flags */
+#define STRBF_FMT_LEFT  0x01
+#define STRBF_FMT_ZERO  0x02
+#define STRBF_FMT_HEX   0x04
+#define STRBF_FMT_UPPER 0x08
+
+/* strbf_put_uri_escaped classes, bytes outside the class are %XX escaped */
+#define STRBF_URI_COMPONENT 0 /* unreserved only: A-Z a-z 0-9 - . _ ~ */
+#define STRBF_URI_SEGMENT   1 /* path segment, also ! $ & ' ( ) * + , ; = : @ */
+#define STRBF_URI_PATH      2 /* path, segment and / */
+#define STRBF_URI_QUERY     3 /* query key or value, path and ? but not & = + */
+
+/* strbf_csv_col_t types, the array data points to */
+#define STRBF_CSV_I32 0 /* const int32_t *, scaled by 10^-prec */
+#define STRBF_CSV_U32 1 /* const uint32_t *, scaled by 10^-prec */
+#define STRBF_CSV_F32 2 /* const float *, prec fraction digits */
+#define STRBF_CSV_F64 3 /* const double *, prec fraction digits */
+
+/* columns of one strbf_put_csv call */
+#ifndef STRBF_CSV_MAX_COLS
+#define STRBF_CSV_MAX_COLS 32
+#endif
+
+    typedef struct strbf_fmt_op_s {
+        uint16_t off;   // literal offset in fmt
+        uint16_t len;   // literal length or worst-case conversion width
+        uint16_t width;
+        int8_t prec;
+        uint8_t type;
+        uint8_t flags;
+    } strbf_fmt_op_t;
+
+    /* compiled format, fmt is referenced and must outlive it */
+    typedef struct strbf_fmt_s {
+        const char * fmt;
+        size_t max;     // worst-case output without strings
+        size_t nops;
+        strbf_fmt_op_t ops[STRBF_FMT_MAX_OPS];
+    } strbf_fmt_t;
+
+    /* one argument of strbf_fmt_execa, member by op type */
+    typedef union strbf_arg_u {
+        long long i;
+        unsigned long long u;
+        double f;
+        const char * s;
+    } strbf_arg_t;
+
+    /* one column of strbf_put_csv */
+    typedef struct strbf_csv_col_s {
+        const void * data;  // column array, indexed by row
+        uint8_t type;       // STRBF_CSV_*
+        uint8_t prec;       // fraction digits, 0..9
+    } strbf_csv_col_t;
+
+    /* one piece for strbf_putv */
+    typedef struct strbf_seg {
+        const char * str;
+        size_t len;
+    } strbf_seg_t;
+
+/* segment from string literal, length known at compile time */
+#define STRBF_SEG(lit) { (lit), sizeof(lit) - 1 }
+/* segment from runtime string */
+#define STRBF_SEG_STR(s) { (s), strlen(s) }
+/* strbf_putv over segments given in place, STRBF_PUTV(sb, STRBF_SEG("a="), {val, n}) */
+#define STRBF_PUTV(sb, ...) \
+    strbf_putv((sb), (const strbf_seg_t[]){__VA_ARGS__}, \
+               sizeof((const strbf_seg_t[]){__VA_ARGS__}) / sizeof(strbf_seg_t))
+
+/* strbf_t flags */
+#define STRBF_F_SPILL 0x01 /* storage is not owned, move to heap when full */
+#define STRBF_F_ROPE  0x02 /* tail chunk of strbf_rope_t, link a new chunk when full */
+#define STRBF_F_SINK  0x04 /* buffer of strbf_sink_t, flush and rewind when full */
+#define STRBF_F_GAP   0x08 /* buffer of strbf_gap_t, headroom and gap for inserts */
+#define STRBF_F_PATH  0x10 /* buffer of strbf_path_t, separator offsets for pop_path */
     
     typedef struct strbf_s {
         char * cur;
         char * end;
         char * start;
         char * max;
+        const strbf_alloc_t * alloc;
+        unsigned flags;
     } strbf_t;
+
+    /* one block of a rope, strbf_chunk_data holds len bytes */
+    typedef struct strbf_chunk_s {
+        struct strbf_chunk_s * next;
+        size_t len;
+        size_t cap;
+    } strbf_chunk_t;
+
+    /* chunk list, appends through sb never copy earlier output */
+    typedef struct strbf_rope_s {
+        strbf_t sb;             // over the tail chunk, pass to strbf_put*
+        strbf_chunk_t * head;
+        strbf_chunk_t * tail;
+        strbf_chunk_t * spare;  // chunks kept by strbf_rope_reset
+        size_t chunk_size;
+        size_t len;             // bytes before the tail chunk
+    } strbf_rope_t;
+
+    /* receives buffered output of a sink, returns 0 or -1 on error */
+    typedef int (*strbf_flush_fn)(void *ctx, const char *data, size_t len);
+
+    /* fixed buffer that hands its content to flush instead of growing */
+    typedef struct strbf_sink_s {
+        strbf_t sb;
+        strbf_flush_fn flush;
+        void * ctx;
+    } strbf_sink_t;
+
+    /* heap buffer with front headroom and a movable gap, content is
+     * start..gap and gap + gap_len..cur, made contiguous when read */
+    typedef struct strbf_gap_s {
+        strbf_t sb;
+        char * base;       // storage, headroom is sb.start - base
+        char * gap;        // NULL when there is none
+        size_t gap_len;
+        size_t headroom;   // front room kept on reset
+    } strbf_gap_t;
+
+    /* heap buffer that keeps the offsets of path separators written by the
+     * put_path functions, so pop_path does not scan for them */
+    typedef struct strbf_path_s {
+        strbf_t sb;
+        size_t mark;                    // length the offsets belong to
+        size_t off[STRBF_PATH_DEPTH];   // separator offsets, ascending
+        uint8_t depth;
+        uint8_t partial;                // separators below off[0] not known
+    } strbf_path_t;
+
+    /* string buffer with inline storage, must not be copied while in use */
+    typedef struct strbf_sso_s {
+        strbf_t sb;
+        char buf[STRBF_SSO_SIZE];
+    } strbf_sso_t;
     
     /**
      * @brief Initialize string buffer
@@ -38,6 +219,183 @@ extern "C" {
      * */
     SB * strbf_inits(SB *sb, char * str, size_t len);
 
+    /**
+     * @brief Initialize string buffer over caller storage that moves to
+     *     heap once it is full, strbf_free releases only the heap copy
+     * @param sb - pointer to string buffer
+     * @param str - initial storage
+     * @param len - size of storage
+     * @return pointer to string buffer
+     * */
+    SB * strbf_init_inline(SB *sb, char * str, size_t len);
+
+    /**
+     * @brief Initialize string buffer with inline storage, the buffer
+     *     pointer stays the same until content outgrows STRBF_SSO_SIZE
+     * @param sso - pointer to inline string buffer
+     * @return pointer to string buffer to pass to strbf_* functions
+     * */
+    SB * strbf_init_sso(strbf_sso_t *sso);
+
+    /**
+     * @brief Set allocator for buffers initialized after this call
+     * @param alloc - allocator, NULL restores malloc/realloc/free
+     * */
+    void strbf_set_default_alloc(const strbf_alloc_t *alloc);
+
+    /**
+     * @brief Initialize string buffer with given capacity from allocator
+     * @param sb - pointer to string buffer
+     * @param cap - capacity in bytes, not counting the terminating 0
+     * @param alloc - allocator, NULL for the default one
+     * @return pointer to string buffer, NULL if allocation failed
+     * */
+    SB * strbf_init_alloc(SB *sb, size_t cap, const strbf_alloc_t *alloc);
+
+    /**
+     * @brief Initialize arena over memory block
+     * @param arena - pointer to arena
+     * @param mem - memory block, kept until the arena is no longer used
+     * @param size - size of memory block
+     * @return allocator to pass to strbf_init_alloc
+     * */
+    const strbf_alloc_t * strbf_arena_init(strbf_arena_t *arena, void *mem, size_t size);
+
+    /**
+     * @brief Release everything allocated from arena, buffers using it
+     *     must not be used or freed afterwards
+     * @param arena - pointer to arena
+     * */
+    void strbf_arena_reset(strbf_arena_t *arena);
+
+    /**
+     * @brief Initialize rope, output goes to chunks of chunk_size bytes,
+     *     a single larger append gets a chunk of its own. Use the returned
+     *     buffer with append functions, functions that look back or
+     *     return the whole content see the tail chunk only
+     * @param rope - pointer to rope
+     * @param chunk_size - usable bytes per chunk
+     * @param alloc - chunk allocator, NULL for the default one
+     * @return buffer to append to, NULL if allocation failed
+     * */
+    SB * strbf_rope_init(strbf_rope_t *rope, size_t chunk_size, const strbf_alloc_t *alloc);
+
+    /**
+     * @brief First chunk of rope for iteration with ->next
+     * @param rope - pointer to rope
+     * @return first chunk, lengths are up to date until the next append
+     * */
+    const strbf_chunk_t * strbf_rope_chunks(strbf_rope_t *rope);
+
+    /**
+     * @brief Bytes of a rope chunk, stored right after the header
+     * @param chunk - chunk from strbf_rope_chunks
+     * @return chunk->len bytes
+     * */
+    const char * strbf_chunk_data(const strbf_chunk_t *chunk);
+
+    /**
+     * @brief Length of rope content
+     * @param rope - pointer to rope
+     * @return total bytes in all chunks
+     * */
+    size_t strbf_rope_len(const strbf_rope_t *rope);
+
+    /**
+     * @brief Write rope content to file descriptor in order and reset it
+     * @param rope - pointer to rope
+     * @param fd - file descriptor
+     * @return 0 on success, -1 on write error, the rope is kept then
+     * */
+    int strbf_rope_flush_fd(strbf_rope_t *rope, int fd);
+
+    /**
+     * @brief Write rope content to stream in order and reset it
+     * @param rope - pointer to rope
+     * @param f - stream
+     * @return 0 on success, -1 on write error, the rope is kept then
+     * */
+    int strbf_rope_flush_file(strbf_rope_t *rope, FILE *f);
+
+    /**
+     * @brief Empty rope, chunks are kept for reuse
+     * @param rope - pointer to rope
+     * */
+    void strbf_rope_reset(strbf_rope_t *rope);
+
+    /**
+     * @brief Free all chunks of rope
+     * @param rope - pointer to rope
+     * */
+    void strbf_rope_free(strbf_rope_t *rope);
+
+    /**
+     * @brief Initialize sink over caller storage, an append that does not
+     *     fit flushes the content and rewinds, strbf_put and strbf_puts
+     *     split longer input across flushes. Functions that look back or
+     *     return the whole content see the unflushed part only
+     * @param sink - pointer to sink
+     * @param buf - storage
+     * @param cap - size of storage
+     * @param flush - receives the content, strbf_sink_fd and
+     *     strbf_sink_file are provided
+     * @param ctx - passed to flush
+     * @return buffer to append to
+     * */
+    SB * strbf_init_sink(strbf_sink_t *sink, char *buf, size_t cap, strbf_flush_fn flush, void *ctx);
+
+    /**
+     * @brief Flush what sink holds, call when done writing
+     * @param sink - pointer to sink
+     * @return 0 on success, -1 when flush failed, the content is kept then
+     * */
+    int strbf_sink_flush(strbf_sink_t *sink);
+
+    /**
+     * @brief Flush function writing to POSIX file descriptor
+     * @param ctx - file descriptor cast with (void *)(intptr_t)fd
+     * */
+    int strbf_sink_fd(void *ctx, const char *data, size_t len);
+
+    /**
+     * @brief Flush function writing to stream
+     * @param ctx - FILE pointer
+     * */
+    int strbf_sink_file(void *ctx, const char *data, size_t len);
+
+    /**
+     * @brief Initialize gap buffer, prepends use the headroom and inserts
+     *     a gap that moves to the insertion point, both cost O(count)
+     *     amortized near the previous one. strbf_get and strbf_finish
+     *     close the gap
+     * @param gap - pointer to gap buffer
+     * @param cap - capacity after start
+     * @param headroom - bytes reserved before start
+     * @return buffer to use with strbf_* functions, NULL if allocation
+     *     failed
+     * */
+    SB * strbf_init_gap(strbf_gap_t *gap, size_t cap, size_t headroom);
+
+    /**
+     * @brief Initialize path buffer, strbf_put_path and friends record
+     *     separator offsets and strbf_pop_path pops them without scanning.
+     *     Other calls that change the length make the next path call fall
+     *     back to scanning
+     * @param path - pointer to path buffer
+     * @param cap - capacity
+     * @return buffer to use with strbf_* functions, NULL if allocation
+     *     failed
+     * */
+    SB * strbf_init_path(strbf_path_t *path, size_t cap);
+
+    /**
+     * @brief Initialize heap string buffer with given capacity
+     * @param sb - pointer to string buffer
+     * @param cap - bytes the buffer holds before it has to grow
+     * @return pointer to string buffer, NULL when allocation failed
+     * */
+    SB * strbf_init_cap(SB *sb, size_t cap);
+
     /**
      * @brief Reset string buffer
      * @param sb - pointer to string buffer
@@ -45,26 +403,70 @@ extern "C" {
      * */
     SB * strbf_reset(SB *sb);
 
+    /**
+     * @brief Make room for at least cap bytes of content
+     * @param sb - pointer to string buffer
+     * @param cap - total capacity wanted
+     * @return 0 on success, -1 on fixed buffer or allocation failure
+     * */
+    int strbf_reserve(SB *sb, size_t cap);
+
+    /**
+     * @brief Make room for len more bytes after the content, growing by
+     *     STRBF_GROW_PCT like appends do
+     * @param sb - pointer to string buffer
+     * @param len - bytes to be written at sb->cur
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_need(SB *sb, size_t len);
+
+    /**
+     * @brief Release unused heap capacity, no-op for fixed buffers
+     * @param sb - pointer to string buffer
+     * @return 0 on success, -1 on allocation failure
+     * */
+    int strbf_shrink_to_fit(SB *sb);
+
+    /**
+     * @brief Get string buffer capacity
+     * @param sb - pointer to string buffer
+     * @return bytes the buffer holds without growing
+     * */
+    size_t strbf_cap(const SB *sb);
+
     /**
      * @brief Put count bytes into string buffer
      * @param sb - pointer to string buffer
      * @param size - new size of buffer
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_put(SB *sb, const char *bytes, size_t count);
+
+    /**
+     * @brief Put segments into string buffer with one growth check
+     * @param sb - pointer to string buffer
+     * @param segs - segments, NULL str is skipped
+     * @param n - number of segments
+     * @return 0 on success, -1 when the buffer cannot grow, nothing is
+     *     appended then
      * */
-    void strbf_put(SB *sb, const char *bytes, size_t count);
+    int strbf_putv(SB *sb, const strbf_seg_t *segs, size_t n);
 
     /**
      * @brief Put count unsigned bytes into string buffer
      * @param sb - pointer to string buffer
      * @param size - new size of buffer
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_putu(SB *sb, const uint8_t * str, size_t count);
+    int strbf_putu(SB *sb, const uint8_t * str, size_t count);
 
     /**
      * @brief Put char into string buffer
      * @param sb - pointer to string buffer
      * @param size - new size of buffer
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_putc(SB *sb, const char str);
+    int strbf_putc(SB *sb, const char str);
 
     /**
      * @brief Put string into string buffer
@@ -92,27 +494,115 @@ extern "C" {
     */
     SB *strbf_sprintf(SB *sb, const char *fmt, ...);
 
+    /**
+     * @brief Put arguments into string buffer according to format in one
+     *     pass, %d %i %u %x %X %c %s %f %% with l/ll, -, 0, width and
+     *     precision (%.Ns, %.Nf up to 10) are formatted natively, the
+     *     first other conversion passes the rest of fmt to vsnprintf
+     * @param sb - pointer to string buffer
+     * @param fmt - format
+     * @param ap - arguments
+     * @return 0 on success, -1 when the buffer cannot grow, the buffer is
+     *     left unchanged then
+     * */
+    int strbf_vsprintf(SB *sb, const char *fmt, va_list ap);
+
+    /**
+     * @brief Compile format once for strbf_fmt_exec, accepts the
+     *     conversions strbf_vsprintf formats natively
+     * @param f - compiled format
+     * @param fmt - format, kept by reference
+     * @return number of arguments, -1 for an unsupported conversion or
+     *     more than STRBF_FMT_MAX_OPS ops
+     * */
+    int strbf_fmt_compile(strbf_fmt_t *f, const char *fmt);
+
+    /**
+     * @brief Put arguments into string buffer with compiled format, the
+     *     buffer grows at most once
+     * @param sb - pointer to string buffer
+     * @param f - compiled format
+     * @param ... - arguments as for the format
+     * @return 0 on success, -1 when the buffer cannot grow, the buffer is
+     *     left unchanged then
+     * */
+    int strbf_fmt_exec(SB *sb, const strbf_fmt_t *f, ...);
+
+    /**
+     * @brief Same as strbf_fmt_exec with typed argument array
+     * @param sb - pointer to string buffer
+     * @param f - compiled format
+     * @param args - one argument per conversion, see STRBF_FMT_* types
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_fmt_execa(SB *sb, const strbf_fmt_t *f, const strbf_arg_t *args);
+
     /**
      * @brief Put int32_t into string buffer
      * @param sb - pointer to string buffer
      * @param val - long value
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_putl(SB *sb, long val);
+    int strbf_putl(SB *sb, long val);
     #define strbf_putn strbf_putl
 
     /**
      * @brief Put uint32_t into string buffer
      * @param sb - pointer to string buffer
      * @param val - unsigned long value
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_putul(SB *sb, uint32_t val);
+    int strbf_putul(SB *sb, uint32_t val);
 
     /**
-     * @brief Put float into string buffer
+     * @brief Put int64_t into string buffer
+     * @param sb - pointer to string buffer
+     * @param val - long long value
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_putll(SB *sb, long long val);
+
+    /**
+     * @brief Put uint64_t into string buffer
+     * @param sb - pointer to string buffer
+     * @param val - unsigned long long value
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_putull(SB *sb, unsigned long long val);
+
+#if defined(__SIZEOF_INT128__)
+    /**
+     * @brief Put 128-bit integer into string buffer
+     * @param sb - pointer to string buffer
+     * @param val - signed 128-bit value
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_puti128(SB *sb, __int128 val);
+
+    /**
+     * @brief Put unsigned 128-bit integer into string buffer
+     * @param sb - pointer to string buffer
+     * @param val - unsigned 128-bit value
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_putu128(SB *sb, unsigned __int128 val);
+#endif
+
+    /**
+     * @brief Put float into string buffer, shortest form that reads back the same
      * @param sb - pointer to string buffer
      * @param val - float value
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_putf(SB *sb, float val);
+    int strbf_putf(SB *sb, float val);
+
+    /**
+     * @brief Put double into string buffer, shortest form that reads back the same
+     * @param sb - pointer to string buffer
+     * @param val - double value
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_putd_shortest(SB *sb, double val);
 
     /**
      * @brief Put double into string buffer
@@ -121,8 +611,9 @@ extern "C" {
      * @param width - width of integer field
      * @param perc - precision
      * @param mark - mark to use for decimal point
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_putd_b(SB *sb, double val, const int8_t width, const uint8_t perc, const uint8_t mark);
+    int strbf_putd_b(SB *sb, double val, const int8_t width, const uint8_t perc, const uint8_t mark);
 
     /**
      * @brief Put double into string buffer
@@ -130,8 +621,35 @@ extern "C" {
      * @param val - double value
      * @param width - width of integer field
      * @param perc - precision
+     * @return 0 on success, -1 when the buffer cannot grow
+     * */
+    int strbf_putd(SB *sb, double val, const int8_t width, const uint8_t perc);
+
+    /**
+     * @brief Put RFC 3339 timestamp into string buffer, without gmtime_r
+     * @param sb - pointer to string buffer
+     * @param t - time since the epoch in units of 10^-prec seconds
+     * @param prec - fraction digits, 0 for seconds, 3 for ms, 6 for us, up to 9
+     * @param tz_offset_min - local offset from UTC in minutes, 0 writes Z
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_putd(SB *sb, double val, const int8_t width, const uint8_t perc);
+    int strbf_put_iso8601(SB *sb, int64_t t, uint8_t prec, int tz_offset_min);
+
+    /**
+     * @brief Put rows of column arrays into string buffer as CSV, fields
+     *     joined by sep and every row ended by a newline. The buffer is sized
+     *     for the whole range up front, integer columns are converted a block
+     *     of rows at a time, with SSE2 or AVX2 where the CPU allows
+     * @param sb - pointer to string buffer
+     * @param cols - column specs
+     * @param ncols - number of columns, 1..STRBF_CSV_MAX_COLS
+     * @param sep - field separator
+     * @param from - first row
+     * @param to - row after the last
+     * @return 0 on success, -1 when the buffer cannot grow, complete rows
+     *     written before are kept
+     * */
+    int strbf_put_csv(SB *sb, const strbf_csv_col_t *cols, size_t ncols, char sep, size_t from, size_t to);
 
     /**
      * @brief Put path separator into string buffer
@@ -172,6 +690,17 @@ extern "C" {
      * */
     SB * strbf_pop_path(SB *sb);
 
+    /**
+     * @brief Normalize path in place in one pass, runs of separators
+     *     become one, "." components go, ".." removes the component before
+     *     it or stays at the start of a relative path and is dropped at
+     *     the root, a trailing separator goes, a path that cancels out
+     *     becomes "."
+     * @param sb - pointer to string buffer
+     * @return pointer to string buffer
+     * */
+    SB * strbf_path_normalize(SB *sb);
+
     /**
      * @brief Put path into string buffer
      * @param sb - pointer to string buffer
@@ -213,30 +742,52 @@ extern "C" {
     SB * strbf_put_uri_at(SB *sb, const char *str, size_t len);
     SB * strbf_pop_uri(SB *sb);
 
+    /**
+     * @brief Put percent-encoded string into string buffer, runs of
+     *     unreserved bytes are copied 16 at a time where the CPU allows
+     * @param sb - pointer to string buffer
+     * @param str - string
+     * @param len - length of string, 0 for strlen
+     * @param cls - STRBF_URI_* class of bytes kept as they are
+     * @return 0 on success, -1 when the buffer cannot grow, fixed buffers
+     *     need room for 3 * len
+     * */
+    int strbf_put_uri_escaped(SB *sb, const char *str, size_t len, int cls);
+
+    /**
+     * @brief Decode %XX escapes in place from offset to the end
+     * @param sb - pointer to string buffer
+     * @param from - offset to start at
+     * @param plus - decode + as space, for form data
+     * @return 0 on success, -1 when a % is not followed by two hex digits,
+     *     it is kept as is
+     * */
+    int strbf_uri_decode_inplace(SB *sb, size_t from, int plus);
+
     /**
      * @brief Put string into string buffer
      * @param sb - pointer to string buffer
      * @param str - string
      * @param count - length of string
-     * @return pointer to string buffer
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_concat(SB *sb, const char *str, size_t count);
+    int strbf_concat(SB *sb, const char *str, size_t count);
 
     /**
      * @brief Put char into string buffer
      * @param sb - pointer to string buffer
      * @param c - char
-     * @return pointer to string buffer
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_concatc(SB *sb, const char c);
+    int strbf_concatc(SB *sb, const char c);
 
     /**
      * @brief Put string into string buffer
      * @param sb - pointer to string buffer
      * @param str - string
-     * @return pointer to string buffer
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_concats(SB *sb, const char *str);
+    int strbf_concats(SB *sb, const char *str);
 
     /** insert string into string */
     /**
@@ -245,24 +796,27 @@ extern "C" {
      * @param str - string
      * @param after - position
      * @param count - length of string
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_insert(SB *sb, const char*str, size_t after, size_t count);
+    int strbf_insert(SB *sb, const char*str, size_t after, size_t count);
 
     /**
      * @brief Insert char into string buffer
      * @param sb - pointer to string buffer
      * @param c - char
      * @param after - position
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_insertc(SB *sb, const char c, size_t after);
+    int strbf_insertc(SB *sb, const char c, size_t after);
 
     /**
      * @brief Insert string into string buffer
      * @param sb - pointer to string buffer
      * @param str - string
      * @param after - position
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_inserts(SB *sb, const char *str, size_t after);
+    int strbf_inserts(SB *sb, const char *str, size_t after);
 
     /**
      * @brief Insert path separator into string buffer
@@ -292,25 +846,25 @@ extern "C" {
      * @param sb - pointer to string buffer
      * @param bytes - string
      * @param count - length of string
-     * @return pointer to string buffer
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_prepend(SB *sb, const char *bytes, size_t count);
+    int strbf_prepend(SB *sb, const char *bytes, size_t count);
 
     /**
      * @brief Prepend char into beginning of string buffer
      * @param sb - pointer to string buffer
      * @param c - char
-     * @return pointer to string buffer
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_prependc(SB *sb, const char c);
+    int strbf_prependc(SB *sb, const char c);
 
     /**
      * @brief Prepend string into beginning of string buffer
      * @param sb - pointer to string buffer
      * @param str - string
-     * @return pointer to string buffer
+     * @return 0 on success, -1 when the buffer cannot grow
      * */
-    void strbf_prepends(SB *sb, const char *str);
+    int strbf_prepends(SB *sb, const char *str);
     
     /**
      * @brief Trim string buffer
@@ -318,6 +872,83 @@ extern "C" {
      * @return pointer to string buffer
      * */
     void strbf_trim(SB *sb);
+
+    /**
+     * @brief Trim bytes of a set from both ends of string buffer
+     * @param sb - pointer to string buffer
+     * @param set - bytes to remove
+     * */
+    void strbf_trim_set(SB *sb, const char *set);
+
+    /**
+     * @brief Length of the leading run of bytes that are in a set, like
+     *     strspn but bounded by len, scans 16-32 bytes per step where
+     *     the CPU allows
+     * @param s - bytes to scan
+     * @param len - number of bytes
+     * @param set - bytes of the class
+     * @return run length, len when every byte is in the set
+     * */
+    size_t strbf_span(const char *s, size_t len, const char *set);
+
+    /**
+     * @brief Length of the leading run of bytes that are not in a set,
+     *     like strcspn but bounded by len
+     * @param s - bytes to scan
+     * @param len - number of bytes
+     * @param set - bytes of the class
+     * @return offset of the first byte in the set, len when none is
+     * */
+    size_t strbf_cspan(const char *s, size_t len, const char *set);
+
+    /**
+     * @brief Length of the trailing run of bytes that are in a set
+     * @param s - bytes to scan
+     * @param len - number of bytes
+     * @param set - bytes of the class
+     * @return run length, len when every byte is in the set
+     * */
+    size_t strbf_rspan(const char *s, size_t len, const char *set);
+
+    /**
+     * @brief Find the first occurrence of needle at or after from
+     * @param sb - pointer to string buffer
+     * @param needle - string to find, an empty one matches at from
+     * @param from - offset to start at
+     * @return offset of the match, STRBF_NPOS when there is none
+     * */
+    size_t strbf_find(SB *sb, const char *needle, size_t from);
+
+    /**
+     * @brief Find the last occurrence of needle starting at or before from
+     * @param sb - pointer to string buffer
+     * @param needle - string to find
+     * @param from - last offset a match may start at, STRBF_NPOS for the
+     *     whole buffer
+     * @return offset of the match, STRBF_NPOS when there is none
+     * */
+    size_t strbf_rfind(SB *sb, const char *needle, size_t from);
+
+    /**
+     * @brief Count non-overlapping occurrences of needle
+     * @param sb - pointer to string buffer
+     * @param needle - string to count, an empty one counts 0
+     * @return number of occurrences
+     * */
+    size_t strbf_count(SB *sb, const char *needle);
+
+    /**
+     * @brief Replace every non-overlapping occurrence of needle in one
+     *     pass, a longer replacement grows the buffer once. Ropes and
+     *     sinks replace in the bytes not yet linked or flushed and must
+     *     have room for the growth
+     * @param sb - pointer to string buffer
+     * @param needle - string to replace, an empty one replaces nothing
+     * @param repl - replacement
+     * @return number of replacements, STRBF_NPOS when the buffer cannot
+     *     grow, the content is unchanged then
+     * */
+    size_t strbf_replace_all(SB *sb, const char *needle, const char *repl);
     
     /**
      * @brief Cut schars from beginning of string buffer
@@ -348,7 +979,7 @@ extern "C" {
      * @param sb - pointer to string buffer
      * @return pointer to string buffer
      * */
-    char *strbf_finish(const SB *sb);
+    char *strbf_finish(SB *sb);
 
     /**
      * @brief Finish url buffer, end string with '\0'
@@ -362,7 +993,7 @@ extern "C" {
      * @param sb - pointer to string buffer
      * @return pointer to string buffer
      * */
-    char *strbf_get(const SB *sb);
+    char *strbf_get(SB *sb);
 
     /**
      * @brief Get string buffer length
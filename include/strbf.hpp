@@ -0,0 +1,245 @@
+#ifndef B18FD42E_C3C5_4EA0_9C23_0EA74081D7D2
+#define B18FD42E_C3C5_4EA0_9C23_0EA74081D7D2
+
+/*
+ * C++17 helpers over strbf_t, header only.
+ *
+ *   strbf::build(&sb, "lat=", lat, " spd=", strbf::fixed<2>(speed), '\n');
+ *
+ *   strbf::buffer buf;
+ *   std::format_to(buf.out(), "{} {}", a, b);
+ *
+ * Every argument type knows its largest output, so a whole expression
+ * makes one growth check and then writes without further checks.
+ */
+
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "numstr.h"
+#include "strbf.h"
+
+namespace strbf {
+
+    /* double with N fraction digits, rounded half to even */
+    template <unsigned N>
+    struct fixed {
+        double val;
+        constexpr explicit fixed(double v) : val(v) {}
+    };
+
+    namespace detail {
+
+        /* put<T>::size(v) is an upper bound of the output, constant where
+         * the type allows, put<T>::write(p, v) returns the end. Writers may
+         * store a terminating 0 after the end, strbf_t has room for it. */
+        template <typename T, typename = void>
+        struct put {
+            static_assert(sizeof(T) == 0, "strbf::build: unsupported argument type");
+        };
+
+        template <typename T>
+        struct put<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>>> {
+            static constexpr size_t max = std::numeric_limits<T>::digits10 + 1 + std::is_signed_v<T>;
+            static constexpr size_t size(T) { return max; }
+            static char *write(char *p, T v) {
+#if defined(__SIZEOF_INT128__)
+                // __int128 is integral under gnu++ modes
+                if constexpr (sizeof(T) > sizeof(long long)) {
+                    if constexpr (std::is_signed_v<T>)
+                        return p + xi128toa(v, p);
+                    else
+                        return p + xu128toa(v, p);
+                } else
+#endif
+                if constexpr (std::is_signed_v<T>) {
+                    if constexpr (sizeof(T) <= sizeof(long))
+                        return p + xltoa(v, p);
+                    else
+                        return p + xlltoa(v, p);
+                } else {
+                    if constexpr (sizeof(T) <= sizeof(unsigned long))
+                        return p + xultoa(v, p);
+                    else
+                        return p + xulltoa(v, p);
+                }
+            }
+        };
+
+        template <>
+        struct put<char> {
+            static constexpr size_t size(char) { return 1; }
+            static char *write(char *p, char c) {
+                *p = c;
+                return p + 1;
+            }
+        };
+
+        template <>
+        struct put<bool> {
+            static constexpr size_t size(bool) { return 5; }
+            static char *write(char *p, bool v) {
+                std::memcpy(p, v ? "true" : "false", 5);
+                return p + (v ? 4 : 5);
+            }
+        };
+
+        template <typename T>
+        struct put<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+            static constexpr size_t size(T) { return XDTOA_SHORTEST_BUFSIZE - 1; }
+            static char *write(char *p, T v) {
+                if constexpr (std::is_same_v<T, float>)
+                    return p + xftoa_shortest(v, p);
+                else
+                    return p + xdtoa_shortest(v, p);
+            }
+        };
+
+        template <unsigned N>
+        struct put<fixed<N>> {
+            // sign, 19 integer digits below 1e19, point and fraction,
+            // huge values print every integer digit
+            static constexpr size_t max = 1 + 19 + (N ? N + 1 : 0);
+            static constexpr size_t size(fixed<N> v) {
+                return v.val > -1e19 && v.val < 1e19 ? max : max + 290;
+            }
+            static char *write(char *p, fixed<N> v) {
+                static_assert(N < 256, "strbf::fixed: precision must fit uint8_t");
+                xdtostrf_b(v.val, 0, N, p, ' ');
+                return p + std::strlen(p);
+            }
+        };
+
+        // char arrays are bounded by their size, literals exactly
+        template <size_t N>
+        struct put<char[N]> {
+            static constexpr size_t size(const char (&)[N]) { return N - 1; }
+            static char *write(char *p, const char (&s)[N]) {
+                size_t len = strnlen(s, N - 1);
+                std::memcpy(p, s, len);
+                return p + len;
+            }
+        };
+
+        template <>
+        struct put<std::string_view> {
+            static size_t size(std::string_view s) { return s.size(); }
+            static char *write(char *p, std::string_view s) {
+                std::memcpy(p, s.data(), s.size());
+                return p + s.size();
+            }
+        };
+
+        template <>
+        struct put<std::string> : put<std::string_view> {};
+
+        template <>
+        struct put<const char *> {
+            static size_t size(const char *s) { return s ? std::strlen(s) : 0; }
+            static char *write(char *p, const char *s) {
+                return s ? put<std::string_view>::write(p, s) : p;
+            }
+        };
+
+        template <>
+        struct put<char *> : put<const char *> {};
+
+    } // namespace detail
+
+    /**
+     * @brief Append all arguments to string buffer with one growth check,
+     *     strings and integers as is, floating point shortest round-trip,
+     *     fixed<N> with N fraction digits
+     * @param sb - pointer to string buffer
+     * @param args - values to append
+     * @return 0 on success, -1 when the buffer cannot grow, nothing is
+     *     appended then, fixed buffers need room for the worst case
+     * */
+    template <typename... Args>
+    inline int build(strbf_t *sb, const Args &...args) {
+        size_t need = (size_t(0) + ... + detail::put<Args>::size(args));
+        if (strbf_need(sb, need))
+            return -1;
+        char *p = sb->cur;
+        ((p = detail::put<Args>::write(p, args)), ...);
+        sb->cur = p;
+        return 0;
+    }
+
+    /*
+     * Owning string buffer. Move-only, moving hands over the heap block
+     * without copying, a moved-from buffer can only be assigned to or
+     * destroyed. Appends that cannot grow the buffer are dropped, build()
+     * and the C API called on get() report them.
+     */
+    class buffer {
+    public:
+        using value_type = char;
+
+        buffer() { strbf_init(&sb_); }
+        explicit buffer(size_t cap) { strbf_init_cap(&sb_, cap); }
+        buffer(size_t cap, const strbf_alloc_t *alloc) { strbf_init_alloc(&sb_, cap, alloc); }
+        ~buffer() { strbf_free(&sb_); }
+
+        buffer(const buffer &) = delete;
+        buffer &operator=(const buffer &) = delete;
+        buffer(buffer &&o) noexcept : sb_(o.sb_) { o.sb_ = strbf_t{}; }
+        buffer &operator=(buffer &&o) noexcept {
+            if (this != &o) {
+                strbf_free(&sb_);
+                sb_ = o.sb_;
+                o.sb_ = strbf_t{};
+            }
+            return *this;
+        }
+
+        strbf_t *get() noexcept { return &sb_; }
+        operator strbf_t *() noexcept { return &sb_; }
+
+        const char *data() const noexcept { return sb_.start; }
+        size_t size() const noexcept { return sb_.cur - sb_.start; }
+        bool empty() const noexcept { return sb_.cur == sb_.start; }
+        void clear() noexcept { sb_.cur = sb_.start; }
+        // never a gap buffer, terminating in place only writes the content
+        const char *c_str() const noexcept {
+            if (!sb_.start)
+                return "";
+            *sb_.cur = 0;
+            return sb_.start;
+        }
+
+        std::string_view view() const noexcept { return {sb_.start, size()}; }
+        operator std::string_view() const noexcept { return view(); }
+
+        void push_back(char c) {
+            if (sb_.cur < sb_.end)
+                *sb_.cur++ = c;
+            else
+                strbf_putc(&sb_, c);
+        }
+        buffer &operator+=(char c) {
+            push_back(c);
+            return *this;
+        }
+        buffer &operator+=(std::string_view s) {
+            strbf_put(&sb_, s.data(), s.size());
+            return *this;
+        }
+
+        template <typename... Args>
+        int append(const Args &...args) { return build(&sb_, args...); }
+
+        /* output iterator for std::format_to, fmt::format_to, std::copy */
+        std::back_insert_iterator<buffer> out() { return std::back_inserter(*this); }
+
+    private:
+        strbf_t sb_{};
+    };
+
+} // namespace strbf
+
+#endif /* B18FD42E_C3C5_4EA0_9C23_0EA74081D7D2 */
@@ -1,54 +1,610 @@
+#include <limits.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdbool.h>
 
 #include "numstr.h"
+#include "numstr_tables.h"
 #if defined(ESP_PLATFORM)
 #include "logger_common.h"
 #endif
 
 #define MAX_PRECISION (10)
-static const double rounders[MAX_PRECISION + 1] = {
-    0.5,           // 0
-    0.05,          // 1
-    0.005,         // 2
-    0.0005,        // 3
-    0.00005,       // 4
-    0.000005,      // 5
-    0.0000005,     // 6
-    0.00000005,    // 7
-    0.000000005,   // 8
-    0.0000000005,  // 9
-    0.00000000005  // 10
-};
-
 static const char digits[201] = "0001020304050607080910111213141516171819"
                                 "2021222324252627282930313233343536373839"
                                 "4041424344454647484950515253545556575859"
                                 "6061626364656667686970717273747576777879"
                                 "8081828384858687888990919293949596979899";
 
+static const uint32_t pow10_u32[10] = {
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL,
+    1000000UL, 10000000UL, 100000000UL, 1000000000UL
+};
+
+static const uint64_t pow10_u64[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+    1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL,
+    10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+// ceil(2^48 / 10^k) for k = 2, 4, 6; ((v * m) >> 16) + 1 holds v / 10^k
+// in 32.32 fixed point, exact enough to peel off all pairs for v < 10^(k+2)
+static const uint64_t frac_mul[4] = {
+    0, 2814749767107ULL, 28147497672ULL, 281474977ULL
+};
+
+#if defined(__GNUC__)
+#define bit_len32(x) (32 - __builtin_clz(x))
+#define bit_len64(x) (64 - __builtin_clzll(x))
+#else
+static inline unsigned bit_len32(uint32_t x) {
+    unsigned n = 0;
+    while (x) ++n, x >>= 1;
+    return n;
+}
+static inline unsigned bit_len64(uint64_t x) {
+    unsigned n = 0;
+    while (x) ++n, x >>= 1;
+    return n;
+}
+#endif
+
+// digit count from bit length: log10(2) ~ 1233/4096, one table fix-up
+static inline unsigned u32_len(uint32_t v) {
+    v |= 1;
+    unsigned t = (bit_len32(v) * 1233) >> 12;
+    return t + 1 - (v < pow10_u32[t]);
+}
+
+static inline unsigned u64_len(uint64_t v) {
+    v |= 1;
+    unsigned t = (bit_len64(v) * 1233) >> 12;
+    return t + 1 - (v < pow10_u64[t]);
+}
+
+#define put_pair(p, i) memcpy((p), digits + (i) * 2, 2)
+
+// write exactly n (1..8) digits of v < 10^n, front to back, no division
+static inline char *put_u32_n(char *p, uint32_t v, unsigned n) {
+    uint64_t y;
+    if (n < 3) {
+        if (n == 1)
+            *p++ = '0' + v;
+        else
+            put_pair(p, v), p += 2;
+        return p;
+    }
+    unsigned k = (n - 1) >> 1;  // pairs after the leading group
+    y = ((v * frac_mul[k]) >> 16) + 1;
+    if (n & 1)
+        *p++ = '0' + (y >> 32);
+    else
+        put_pair(p, y >> 32), p += 2;
+    switch (k) {
+        case 3:
+            y = (uint32_t)y * 100ULL, put_pair(p, y >> 32), p += 2;
+            // fall through
+        case 2:
+            y = (uint32_t)y * 100ULL, put_pair(p, y >> 32), p += 2;
+            // fall through
+        default:
+            y = (uint32_t)y * 100ULL, put_pair(p, y >> 32), p += 2;
+    }
+    return p;
+}
+
+// write v < 10^8 as exactly 8 digits, zero padded
+static inline char *put_u32_8(char *p, uint32_t v) {
+    return put_u32_n(p, v, 8);
+}
+
+static char *put_u32(char *p, uint32_t v) {
+    if (v < 100000000UL)
+        return put_u32_n(p, v, u32_len(v));
+    uint32_t hi = v / 100000000UL;
+    p = put_u32_n(p, hi, 1 + (hi > 9));
+    return put_u32_8(p, v - hi * 100000000UL);
+}
+
+static inline uint64_t mulhi64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    return (uint64_t)(((unsigned __int128)a * b) >> 64);
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    return (hi_lo >> 32) + (cross >> 32) + hi_hi;
+#endif
+}
+
+// v / 10^8 by reciprocal, ceil(2^90 / 10^8) is exact for every 64-bit v,
+// keeps 32-bit cores away from the __udivdi3 call
+static inline uint64_t div_1e8(uint64_t v) {
+    return mulhi64(v, 0xABCC77118461CEFDULL) >> 26;
+}
+
+// 64-bit values are cut into 8-digit chunks once, every chunk is then
+// formatted with 32-bit arithmetic only
+static char *put_u64(char *p, uint64_t v) {
+    if (v <= UINT32_MAX)
+        return put_u32(p, (uint32_t)v);
+    uint64_t hi = div_1e8(v);
+    uint32_t lo = (uint32_t)v - (uint32_t)hi * 100000000U;
+    if (hi <= UINT32_MAX) {
+        p = put_u32(p, (uint32_t)hi);
+    } else {
+        uint32_t top = (uint32_t)div_1e8(hi);
+        p = put_u32(p, top);
+        p = put_u32_8(p, (uint32_t)hi - top * 100000000U);
+    }
+    return put_u32_8(p, lo);
+}
+
+#if defined(__SIZEOF_INT128__)
+#define POW10_16 10000000000000000ULL
+
+// 16 digits, zero padded
+static inline char *put_u64_16(char *p, uint64_t v) {
+    uint64_t hi = div_1e8(v);
+    p = put_u32_8(p, (uint32_t)hi);
+    return put_u32_8(p, (uint32_t)v - (uint32_t)hi * 100000000U);
+}
+
+static char *put_u128(char *p, unsigned __int128 v) {
+    if (v <= UINT64_MAX)
+        return put_u64(p, (uint64_t)v);
+    unsigned __int128 hi = v / POW10_16;
+    uint64_t lo = (uint64_t)(v - hi * POW10_16);
+    if (hi <= UINT64_MAX) {
+        p = put_u64(p, (uint64_t)hi);
+    } else {
+        uint64_t top = (uint64_t)(hi / POW10_16);
+        p = put_u64(p, top);
+        p = put_u64_16(p, (uint64_t)(hi - (unsigned __int128)top * POW10_16));
+    }
+    return put_u64_16(p, lo);
+}
+#endif
+
 size_t xint_len(size_t value) {
-    size_t l = !value;
-    while (value) {
-        l++;
-        value /= 10;
+    return u64_len(value);
+}
+
+#if ULONG_MAX == UINT32_MAX
+#define put_ulong put_u32
+#else
+#define put_ulong put_u64
+#endif
+
+size_t xultoa(unsigned long value, char *dst) {
+    assert(dst);
+    char *p = put_ulong(dst, value);
+    *p = 0;
+    return p - dst;
+}
+
+size_t xltoa(long value, char *dst) {
+    assert(dst);
+    char *p = dst;
+    unsigned long u = value;
+    if (value < 0) {
+        u = 0UL - u;
+        *p++ = '-';
     }
-    return l;
+    p = put_ulong(p, u);
+    *p = 0;
+    return p - dst;
+}
+
+size_t xulltoa(unsigned long long value, char *dst) {
+    assert(dst);
+    char *p = put_u64(dst, value);
+    *p = 0;
+    return p - dst;
+}
+
+size_t xlltoa(long long value, char *dst) {
+    assert(dst);
+    char *p = dst;
+    unsigned long long u = value;
+    if (value < 0) {
+        u = 0ULL - u;
+        *p++ = '-';
+    }
+    p = put_u64(p, u);
+    *p = 0;
+    return p - dst;
+}
+
+size_t xint_len64(uint64_t value) {
+    return u64_len(value);
+}
+
+#if defined(__SIZEOF_INT128__)
+size_t xu128toa(unsigned __int128 value, char *dst) {
+    assert(dst);
+    char *p = put_u128(dst, value);
+    *p = 0;
+    return p - dst;
+}
+
+size_t xi128toa(__int128 value, char *dst) {
+    assert(dst);
+    char *p = dst;
+    unsigned __int128 u = value;
+    if (value < 0) {
+        u = 0 - u;
+        *p++ = '-';
+    }
+    p = put_u128(p, u);
+    *p = 0;
+    return p - dst;
+}
+#endif
+
+/*
+ * Shortest round-trip formatting after Ryu (Ulf Adams, PLDI 2018): the
+ * rounding interval of the binary value is scaled to decimal with one
+ * 125-bit table multiply and digits are dropped while both ends still
+ * differ, so the result is the shortest string that reads back the same.
+ */
+
+// multiply by reciprocal, no 64-bit division on 32-bit cores
+static inline uint64_t div5(uint64_t x) { return mulhi64(x, 0xCCCCCCCCCCCCCCCDULL) >> 2; }
+static inline uint64_t div10(uint64_t x) { return mulhi64(x, 0xCCCCCCCCCCCCCCCDULL) >> 3; }
+static inline uint64_t div100(uint64_t x) { return mulhi64(x >> 2, 0x28F5C28F5C28F5C3ULL) >> 2; }
+
+// ceil(log2(5^e)) for e > 0, 1 for e == 0
+static inline int32_t pow5bits(int32_t e) { return ((e * 1217359) >> 19) + 1; }
+// floor(log10(2^e)) and floor(log10(5^e)) for 0 <= e <= 1650
+static inline uint32_t log10_pow2(int32_t e) { return (e * 78913) >> 18; }
+static inline uint32_t log10_pow5(int32_t e) { return (e * 732923) >> 20; }
+
+static inline bool multiple_of_pow5(uint64_t v, uint32_t p) {
+    uint32_t count = 0;
+    for (;;) {
+        uint64_t q = div5(v);
+        if ((uint32_t)v - 5 * (uint32_t)q)
+            break;
+        v = q;
+        ++count;
+    }
+    return count >= p;
+}
+
+static inline bool multiple_of_pow2(uint64_t v, uint32_t p) {
+    return (v & ((1ULL << p) - 1)) == 0;
+}
+
+// (m * mul) >> j for a 125-bit table entry, j > 64
+static inline uint64_t mul_shift64(uint64_t m, const uint64_t *mul, int32_t j) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 b0 = (unsigned __int128)m * mul[0];
+    unsigned __int128 b2 = (unsigned __int128)m * mul[1];
+    return (uint64_t)(((b0 >> 64) + b2) >> (j - 64));
+#else
+    uint64_t b0_hi = mulhi64(m, mul[0]);
+    uint64_t b2_lo = m * mul[1], b2_hi = mulhi64(m, mul[1]);
+    uint64_t sum = b0_hi + b2_lo;
+    b2_hi += sum < b0_hi;
+    j -= 64;
+    return (b2_hi << (64 - j)) | (sum >> j);
+#endif
+}
+
+/*
+ * m2 * 2^e2 with both ends of the rounding interval as 4*m2 -/+ 2,
+ * returns digits and stores the decimal exponent into e10
+ */
+static uint64_t shortest_dec(uint64_t m2, int32_t e2, uint32_t mm_shift, bool even, int32_t *e10) {
+    uint64_t mv = 4 * m2, vr, vp, vm;
+    bool vm_zeros = false, vr_zeros = false;
+    int32_t e;
+
+    if (e2 >= 0) {
+        uint32_t q = log10_pow2(e2) - (e2 > 3);
+        int32_t k = POW5_INV_BITCOUNT + pow5bits(q) - 1;
+        int32_t i = -e2 + (int32_t)q + k;
+        e = q;
+        vr = mul_shift64(mv, pow5_inv_split[q], i);
+        vp = mul_shift64(mv + 2, pow5_inv_split[q], i);
+        vm = mul_shift64(mv - 1 - mm_shift, pow5_inv_split[q], i);
+        if (q <= 21) {
+            if ((uint32_t)mv - 5 * (uint32_t)div5(mv) == 0)
+                vr_zeros = multiple_of_pow5(mv, q);
+            else if (even)
+                vm_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+            else
+                vp -= multiple_of_pow5(mv + 2, q);
+        }
+    } else {
+        uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+        int32_t i = -e2 - (int32_t)q;
+        int32_t k = pow5bits(i) - POW5_BITCOUNT;
+        int32_t j = (int32_t)q - k;
+        e = (int32_t)q + e2;
+        vr = mul_shift64(mv, pow5_split[i], j);
+        vp = mul_shift64(mv + 2, pow5_split[i], j);
+        vm = mul_shift64(mv - 1 - mm_shift, pow5_split[i], j);
+        if (q <= 1) {
+            vr_zeros = true;
+            if (even)
+                vm_zeros = mm_shift == 1;
+            else
+                --vp;
+        } else if (q < 63) {
+            vr_zeros = multiple_of_pow2(mv, q);
+        }
+    }
+
+    uint8_t last = 0;
+    uint64_t out;
+    if (vm_zeros || vr_zeros) {
+        // exact interval ends, rare
+        for (;;) {
+            uint64_t vp10 = div10(vp), vm10 = div10(vm), vr10;
+            if (vp10 <= vm10)
+                break;
+            vr10 = div10(vr);
+            vm_zeros &= (uint32_t)vm - 10 * (uint32_t)vm10 == 0;
+            vr_zeros &= last == 0;
+            last = (uint32_t)vr - 10 * (uint32_t)vr10;
+            vr = vr10, vp = vp10, vm = vm10;
+            ++e;
+        }
+        if (vm_zeros) {
+            for (;;) {
+                uint64_t vm10 = div10(vm), vr10;
+                if ((uint32_t)vm - 10 * (uint32_t)vm10)
+                    break;
+                vr10 = div10(vr);
+                vr_zeros &= last == 0;
+                last = (uint32_t)vr - 10 * (uint32_t)vr10;
+                vr = vr10, vp = div10(vp), vm = vm10;
+                ++e;
+            }
+        }
+        if (vr_zeros && last == 5 && !(vr & 1))
+            last = 4;  // exact ...50..0, round half to even
+        out = vr + ((vr == vm && (!even || !vm_zeros)) || last >= 5);
+    } else {
+        bool up = false;
+        uint64_t vp100 = div100(vp), vm100 = div100(vm);
+        if (vp100 > vm100) {
+            uint64_t vr100 = div100(vr);
+            up = (uint32_t)vr - 100 * (uint32_t)vr100 >= 50;
+            vr = vr100, vp = vp100, vm = vm100;
+            e += 2;
+        }
+        for (;;) {
+            uint64_t vp10 = div10(vp), vm10 = div10(vm), vr10;
+            if (vp10 <= vm10)
+                break;
+            vr10 = div10(vr);
+            up = (uint32_t)vr - 10 * (uint32_t)vr10 >= 5;
+            vr = vr10, vp = vp10, vm = vm10;
+            ++e;
+        }
+        out = vr + (vr == vm || up);
+    }
+    *e10 = e;
+    return out;
+}
+
+// m * 10^e, plain notation for 1e-6 <= |v| < 1e21, d.ddde+XX otherwise
+static char *put_dec(char *p, uint64_t m, int32_t e) {
+    int32_t n = u64_len(m), dp = n + e;
+    if (dp > 0 && dp <= 21) {
+        if (e >= 0) {
+            p = put_u64(p, m);
+            memset(p, '0', e), p += e;
+        } else {
+            put_u64(p, m);
+            memmove(p + dp + 1, p + dp, n - dp);
+            p[dp] = '.';
+            p += n + 1;
+        }
+    } else if (dp > -6 && dp <= 0) {
+        *p++ = '0', *p++ = '.';
+        memset(p, '0', -dp), p -= dp;
+        p = put_u64(p, m);
+    } else {
+        put_u64(p + 1, m);
+        p[0] = p[1];
+        if (n > 1)
+            p[1] = '.', p += n + 1;
+        else
+            ++p;
+        *p++ = 'e';
+        if (--dp < 0)
+            *p++ = '-', dp = -dp;
+        else
+            *p++ = '+';
+        p = put_u32(p, dp);
+    }
+    return p;
+}
+
+static char *put_special(char *p, bool neg, bool nan, bool zero) {
+    if (nan) {
+        memcpy(p, "nan", 3);
+        return p + 3;
+    }
+    if (neg)
+        *p++ = '-';
+    if (zero) {
+        *p++ = '0';
+        return p;
+    }
+    memcpy(p, "inf", 3);
+    return p + 3;
+}
+
+size_t xdtoa_shortest(double val, char *dst) {
+    assert(dst);
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    bool neg = bits >> 63;
+    uint64_t mant = bits & ((1ULL << 52) - 1);
+    uint32_t exp = (bits >> 52) & 0x7ff;
+    char *p = dst;
+    if (exp == 0x7ff || (!exp && !mant)) {
+        p = put_special(p, neg, mant != 0, !exp);
+    } else {
+        uint64_t m2 = exp ? (1ULL << 52) | mant : mant;
+        int32_t e2 = (exp ? (int32_t)exp : 1) - 1023 - 52 - 2, e10;
+        uint64_t m;
+        if (neg)
+            *p++ = '-';
+        m = shortest_dec(m2, e2, mant != 0 || exp <= 1, !(m2 & 1), &e10);
+        p = put_dec(p, m, e10);
+    }
+    *p = 0;
+    return p - dst;
+}
+
+size_t xftoa_shortest(float val, char *dst) {
+    assert(dst);
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    bool neg = bits >> 31;
+    uint32_t mant = bits & ((1UL << 23) - 1);
+    uint32_t exp = (bits >> 23) & 0xff;
+    char *p = dst;
+    if (exp == 0xff || (!exp && !mant)) {
+        p = put_special(p, neg, mant != 0, !exp);
+    } else {
+        uint32_t m2 = exp ? (1UL << 23) | mant : mant;
+        int32_t e2 = (exp ? (int32_t)exp : 1) - 127 - 23 - 2, e10;
+        uint64_t m;
+        if (neg)
+            *p++ = '-';
+        m = shortest_dec(m2, e2, mant != 0 || exp <= 1, !(m2 & 1), &e10);
+        p = put_dec(p, m, e10);
+    }
+    *p = 0;
+    return p - dst;
+}
+
+/*
+ * Fixed-precision core shared by xftoa, xdtostrf_b and f_to_char_f.
+ * The value is split into its exact integer part and exact fraction,
+ * the fraction is scaled to prec digits with one integer multiply and
+ * rounded half to even on the exact binary value, no per digit
+ * floating point work.
+ */
+typedef struct {
+    uint64_t ip;     // integer part, shortest digits for huge values
+    uint64_t fp;     // fraction scaled to 10^prec
+    uint32_t ip_exp; // zeros after ip digits, huge values only
+} fixed_t;
+
+// round(fp * 10^prec) half to even, 0 <= fp < 1, odd is the parity of
+// the integer part when prec == 0
+static uint64_t scale_frac(double fp, unsigned prec, bool odd) {
+    uint64_t bits, m, pow = pow10_u64[prec], lo, hi, q;
+    uint32_t be, s;
+    int cmp;
+    if (fp == 0)
+        return 0;
+    memcpy(&bits, &fp, sizeof(bits));
+    be = (bits >> 52) & 0x7ff;
+    m = bits & ((1ULL << 52) - 1);
+    if (be)
+        m |= 1ULL << 52, s = 1075 - be;
+    else
+        s = 1074;
+    // fp = m / 2^s with s >= 53, so m * 10^prec / 2^s < 10^prec
+    if (s >= 128)
+        return 0;
+    lo = m * pow;
+    hi = mulhi64(m, pow);
+    if (s >= 64) {
+        uint32_t t = s - 64;
+        if (t) {
+            uint64_t r = hi & ((1ULL << t) - 1), half = 1ULL << (t - 1);
+            q = hi >> t;
+            cmp = r > half ? 1 : r < half ? -1 : lo != 0;
+        } else {
+            q = hi;
+            cmp = lo > (1ULL << 63) ? 1 : lo < (1ULL << 63) ? -1 : 0;
+        }
+    } else {
+        uint64_t r = lo & ((1ULL << s) - 1), half = 1ULL << (s - 1);
+        q = (hi << (64 - s)) | (lo >> s);
+        cmp = r > half ? 1 : r < half ? -1 : 0;
+    }
+    if (prec)
+        odd = q & 1;
+    return q + (cmp > 0 || (cmp == 0 && odd));
+}
+
+// v >= 0 and finite, returns the number of integer digits
+static unsigned fixed_init(fixed_t *x, double v, unsigned prec) {
+    if (prec > MAX_PRECISION)
+        prec = MAX_PRECISION;
+    x->ip_exp = 0;
+    if (v >= 18446744073709551616.0) {
+        // no fraction left at this size, print the shortest digits
+        uint64_t bits, mant;
+        int32_t e10;
+        memcpy(&bits, &v, sizeof(bits));
+        mant = bits & ((1ULL << 52) - 1);
+        x->ip = shortest_dec((1ULL << 52) | mant, (int32_t)((bits >> 52) & 0x7ff) - 1023 - 52 - 2,
+                             mant != 0, !(mant & 1), &e10);
+        x->ip_exp = e10;
+        x->fp = 0;
+    } else {
+        x->ip = (uint64_t)v;
+        x->fp = scale_frac(v - (double)x->ip, prec, x->ip & 1);
+        if (x->fp == pow10_u64[prec])
+            ++x->ip, x->fp = 0;
+    }
+    return u64_len(x->ip) + x->ip_exp;
+}
+
+// exactly n (up to 10) digits of v < 10^n, zero padded
+static char *put_u64_n(char *p, uint64_t v, unsigned n) {
+    if (n <= 8)
+        return put_u32_n(p, (uint32_t)v, n);
+    uint32_t hi = (uint32_t)div_1e8(v);
+    p = put_u32_n(p, hi, n - 8);
+    return put_u32_8(p, (uint32_t)v - hi * 100000000U);
+}
+
+static char *put_fixed(char *p, const fixed_t *x, unsigned prec) {
+    p = put_u64(p, x->ip);
+    memset(p, '0', x->ip_exp), p += x->ip_exp;
+    if (prec) {
+        unsigned n = prec > MAX_PRECISION ? MAX_PRECISION : prec;
+        *p++ = '.';
+        p = put_u64_n(p, x->fp, n);
+        memset(p, '0', prec - n), p += prec - n;
+    }
+    return p;
 }
 
 char *xftoa(double f, char *buf, int precision) {
     char *ptr = buf;
-    char *p = ptr;
-    char *p1;
-    char c;
-    long intPart;
+    fixed_t x;
 
     // check precision bounds
     if (precision > MAX_PRECISION)
         precision = MAX_PRECISION;
 
+    if (isnan(f) || isinf(f)) {
+        ptr = put_special(ptr, f < 0, isnan(f), false);
+        *ptr = 0;
+        return buf;
+    }
+
     // sign stuff
     if (f < 0) {
         f = -f;
@@ -73,53 +629,8 @@ char *xftoa(double f, char *buf, int precision) {
             precision = 0;
     }
 
-    // round value according the precision
-    if (precision)
-        f += rounders[precision];
-
-    // integer part...
-    intPart = f;
-    f -= intPart;
-
-    if (!intPart)
-        *ptr++ = '0';
-    else {
-        // save start pointer
-        p = ptr;
-
-        // convert (reverse order)
-        while (intPart) {
-            *p++ = '0' + intPart % 10;
-            intPart /= 10;
-        }
-
-        // save end pos
-        p1 = p;
-
-        // reverse result
-        while (p > ptr) {
-            c = *--p;
-            *p = *ptr;
-            *ptr++ = c;
-        }
-
-        // restore end pos
-        ptr = p1;
-    }
-
-    // decimal part
-    if (precision) {
-        // place decimal point
-        *ptr++ = '.';
-
-        // convert
-        while (precision--) {
-            f *= 10.0;
-            c = f;
-            *ptr++ = '0' + c;
-            f -= c;
-        }
-    }
+    fixed_init(&x, f, precision);
+    ptr = put_fixed(ptr, &x, precision);
 
     // terminating zero
     *ptr = 0;
@@ -127,64 +638,13 @@ char *xftoa(double f, char *buf, int precision) {
     return buf;
 }
 
-size_t xultoa(unsigned long value, char *dst) {
-    assert(dst);
-    size_t length = xint_len(value);
-    size_t next = length - 1;
-    unsigned long i = 0;
-    while (value >= 100) {
-        i = (value % 100) * 2;
-        value /= 100;
-        dst[next] = digits[i + 1];
-        dst[next - 1] = digits[i];
-        next -= 2;
-    }
-    if (value < 10) {
-        dst[next] = '0' + value;
-    } else {
-        i = value * 2;
-        dst[next] = digits[i + 1];
-        dst[next - 1] = digits[i];
-    }
-    dst[length] = 0;
-    return length;
-}
-
-size_t xltoa(long value, char *dst) {
-    assert(dst);
-    size_t length = xint_len(value);
-    size_t next = length - 1;
-    unsigned long i = 0;
-    if (value < 0) {
-        value = -value;
-        length++;
-        next++;
-        *dst = '-';
-    }
-    while (value >= 100) {
-        i = (value % 100) * 2;
-        value /= 100;
-        dst[next] = digits[i + 1];
-        dst[next - 1] = digits[i];
-        next -= 2;
-    }
-    if (value < 10) {
-        dst[next] = '0' + value;
-    } else {
-        i = value * 2;
-        dst[next] = digits[i + 1];
-        dst[next - 1] = digits[i];
-    }
-    dst[length] = 0;
-    return length;
-}
-
 char *xdtostrf(double number, const int8_t width, const uint8_t prec, char *s) {
     return xdtostrf_b(number, width, prec, s, ' ');
 }
 
 char *xdtostrf_b(double number, const int8_t width, const uint8_t prec, char *s, const uint8_t pad_digit) {
     uint8_t negative = 0;
+    fixed_t x;
 
     if (isnan(number)) {
         memcpy(s, "nan", 3);
@@ -211,25 +671,8 @@ char *xdtostrf_b(double number, const int8_t width, const uint8_t prec, char *s,
         number = -number;
     }
 
-    // Round correctly so that print(1.999, 2) prints as "2.00"
-    // I optimized out most of the divisions
-    double rounding = 2.0;
-    for (uint8_t i = 0; i < prec; ++i)
-        rounding *= 10.0;
-    rounding = 1.0 / rounding;
-
-    number += rounding;
-
-    // Figure out how big our number really is
-    double tenpow = 1.0;
-    int digitcount = 1;
-    while (number >= 10.0 * tenpow) {
-        tenpow *= 10.0;
-        digitcount++;
-    }
-
-    number /= tenpow;
-    fillme -= digitcount;
+    // Round once, the digit count of the rounded integer part sets the padding
+    fillme -= fixed_init(&x, number, prec);
 
     if (fillme && pad_digit && pad_digit == ' ') {
         // Pad unused cells with spaces preceeded by minus
@@ -249,40 +692,57 @@ char *xdtostrf_b(double number, const int8_t width, const uint8_t prec, char *s,
         }
     }
 
-    // Print the digits, and if necessary, the decimal point
-    digitcount += prec;
-    int8_t digit = 0;
-    while (digitcount-- > 0) {
-        digit = (int8_t)number;
-        if (digit > 9)
-            digit = 9;  // insurance
-        *out++ = (char)('0' | digit);
-        if ((digitcount == prec) && (prec > 0)) {
-            *out++ = '.';
-        }
-        number -= digit;
-        number *= 10.0;
-    }
+    out = put_fixed(out, &x, prec);
 
     // make sure the string is terminated
     *out = 0;
     return s;
 }
 
-#define MSTRF(fn) if(f > 0){p+=fn(f, p);}else{*p++ = '0';*p = 0;}return p-str;
-
 size_t int_to_char(int32_t f, char *str) {
-    char *p = str;MSTRF(xltoa);
+    return xltoa(f, str);
 }
 
 size_t uint_to_char(uint32_t f, char *str) {
-    char *p = str;MSTRF(xultoa);
+    char *p = put_u32(str, f);
+    *p = 0;
+    return p - str;
+}
+
+// ceil(2^64 / 10^k), mulhi64(v, m) is v / 10^k for every 32-bit v
+static const uint64_t inv_pow10_u32[10] = {
+    0, 0x199999999999999aULL, 0x28f5c28f5c28f5dULL, 0x4189374bc6a7f0ULL, 0x68db8bac710ccULL,
+    0xa7c5ac471b48ULL, 0x10c6f7a0b5eeULL, 0x1ad7f29abcbULL, 0x2af31dc462ULL, 0x44b82fa0aULL
+};
+
+size_t ufix_to_char(uint32_t v, uint8_t prec, char *str) {
+    assert(str && prec <= 9);
+    char *p = str;
+    if (!prec) {
+        p = put_u32(p, v);
+    } else {
+        uint32_t ip = (uint32_t)mulhi64(v, inv_pow10_u32[prec]);
+        p = put_u32(p, ip);
+        *p++ = '.';
+        p = put_u64_n(p, v - ip * pow10_u32[prec], prec);
+    }
+    *p = 0;
+    return p - str;
+}
+
+size_t fix_to_char(int32_t v, uint8_t prec, char *str) {
+    if (v >= 0)
+        return ufix_to_char(v, prec, str);
+    *str = '-';
+    return 1 + ufix_to_char(0U - (uint32_t)v, prec, str + 1);
 }
 
 size_t uint_to_char_pad_zero(uint8_t f, char *str) {
     char *p = str;
     if(f<10) *p++ = '0';
-    MSTRF(xultoa);
+    p = put_u32(p, f);
+    *p = 0;
+    return p - str;
 }
 
 size_t time_to_char_hm(int16_t h, int16_t m, char *str) {
@@ -323,78 +783,25 @@ size_t date_to_char(int16_t d, int16_t m, int16_t y, uint8_t format, char *str)
 }
 
 size_t f_to_char_f(double f, char *str, uint8_t fractionlen, uint8_t padlen) {
-    bool neg = (f<0); 
-    uint32_t full = (uint32_t)(neg?-f:f);
     char *p = str;
-    size_t len=0;
-    uint8_t i=0;
-    uint32_t frac=1;
-    if(neg) {
-        *p='-';++p;++len;
-        if(padlen>0)--padlen;
-    }
-    while (i<padlen){
-        if(f>=1||frac>1){
-            if(frac > f) {*p='0';++p;++len;}
-        }
-        frac *= 10;
-        ++i;
-    }
-    double fr = ((neg?-f:f) - full); // fractional part
-    switch
-    (fractionlen){
-        case 0: 
-            if(fr>=0.5) ++full;
-        break;
-        case 1: 
-            if(fr>=0.95) {
-                ++full; // round up integer part
-                fr=0;
-            }
-            else if(fr < 0.1 && fr>=0.05) fr=0.1;
-        break;
-        case 2: 
-            if(fr>=0.995) {
-                ++full; // round up integer part
-                fr=0;
-            }
-            else if(fr < 0.1 && fr>=0.095) fr=0.1;
-            else if(fr < 0.01 && fr>=0.005)  fr=0.01;
-        break;
-        case 3: 
-            if(fr>=0.9995) {
-                ++full; // round up integer part
-                fr=0;
-            }
-            else if(fr < 0.1 && fr>=0.095) fr=0.1;
-            else if(fr < 0.01 && fr>=0.0095)  fr=0.01;
-            else if(fr < 0.001 && fr>=0.0005)  fr=0.001;
-        break;
-        default: break;
-    }
-
-    len += uint_to_char(full, p); p=str+len;
-    if(fractionlen){
-        *p = '.';++p;++len;
-        i = 0;
-        while (i<fractionlen){
-            fr *= 10;
-            if(i<(fractionlen-1) && fr<1) {*p='0';++p;++len;}
-            ++i;
-        }
-        frac = (uint32_t)fr;
-        fr -= frac;
-        if(fr>=0.5){
-            //if(fractionlen==1) frac=0;
-            //else 
-            ++frac;
-        }
-        len += uint_to_char(frac, p);
+    fixed_t x;
+    unsigned len;
+    if (isnan(f) || isinf(f)) {
+        p = put_special(p, f < 0, isnan(f), false);
+        *p = 0;
+        return p - str;
+    }
+    if (f < 0) {
+        *p++ = '-';
+        f = -f;
+        if (padlen > 0) --padlen;
     }
-    // printf("f_to_char_f converted, orig:%.03f formatted:%s\n", f, str);
-    // if (len>5 && f < 100)
-    // printf("nop -----------------------------------------------------------\n");
-    return len;
+    // zero pad the rounded integer part to padlen digits
+    for (len = fixed_init(&x, f, fractionlen); len < padlen; ++len)
+        *p++ = '0';
+    p = put_fixed(p, &x, fractionlen);
+    *p = 0;
+    return p - str;
 }
 
 size_t f_to_char(double f, char *str, uint8_t fractionlen) {
@@ -420,29 +827,467 @@ size_t concat(char *dst, size_t dlen, const char *src, size_t len) {
     return dlen;
 }
 
-size_t sec_to_hms_str(uint32_t sec, char *str)
-{
-    uint16_t h = sec / 3600;
-    uint16_t m = (sec / 60) % 60;
-    uint16_t s = sec % 60;
+size_t sec_to_hms_str(uint32_t sec, char *str) {
+    return duration_to_str(sec * 1000ULL, 0, str);
+}
+
+/* one divmod chain from ms to the largest field, every field below it
+ * is two digits from the pair table */
+size_t duration_to_str(uint64_t ms, uint8_t flags, char *str) {
+    assert(str);
+    uint64_t sec = ms / 1000, min = sec / 60, h = min / 60, d = 0;
+    uint32_t f = (uint32_t)(ms - sec * 1000);
+    uint32_t s = (uint32_t)(sec - min * 60), m = (uint32_t)(min - h * 60);
     char *p = str;
-    size_t len = 8;
-    memcpy(p, "00:00:00", len), *(p+len)=0;
-    // printf ("sec_to_hms_str: %d %d %d\n", h, m, s);
-    if(h>0){
-        if(h<10) ++p;
-        p += xultoa(h, p), *p=':';
-    }
-    if(m>0){
-        p = str+(len-5);
-        if(m<10) ++p;
-        p += xultoa(m, p), *p=':';
-    }
-    if(s>0){
-        p = str+(len-2);
-        if(s<10) ++p;
-        p += xultoa(s, p);
-    }
-    // printf ("sec_to_hms_str: %s\n", str);
-    return len;
+    if (flags & DURATION_DAYS) {
+        d = h / 24;
+        h -= d * 24;
+        p = put_u64(p, d);
+        *p++ = ':';
+    }
+    if (h < 100) {
+        put_pair(p, h);
+        p += 2;
+    } else {
+        p = put_u64(p, h);
+    }
+    p[0] = ':';
+    put_pair(p + 1, m);
+    p[3] = ':';
+    put_pair(p + 4, s);
+    p += 6;
+    if (flags & DURATION_MS) {
+        *p++ = '.';
+        p = put_u32_n(p, f, 3);
+    }
+    *p = 0;
+    return p - str;
+}
+
+static inline void put_2(char *p, unsigned v) {
+    memcpy(p, digits + (v % 100) * 2, 2);
+}
+
+void ts_cache_init(ts_cache_t *c) {
+    memcpy(c->buf, "0000-00-00T00:00:00.000", TS_CACHE_LEN + 1);
+    c->y = c->ms = 0;
+    c->mo = c->d = c->h = c->mi = c->s = 0;
+}
+
+/* fields are compared one by one, at 10-20 Hz only ms and s move */
+const char *ts_cache_update(ts_cache_t *c, uint16_t y, uint8_t mo, uint8_t d, uint8_t h, uint8_t mi, uint8_t s, uint16_t ms) {
+    if (ms != c->ms) {
+        c->ms = ms;
+        ms %= 1000;
+        c->buf[20] = '0' + ms / 100;
+        put_2(c->buf + 21, ms);
+    }
+    if (s != c->s)
+        put_2(c->buf + 17, c->s = s);
+    if (mi != c->mi)
+        put_2(c->buf + 14, c->mi = mi);
+    if (h != c->h)
+        put_2(c->buf + 11, c->h = h);
+    if (d != c->d)
+        put_2(c->buf + 8, c->d = d);
+    if (mo != c->mo)
+        put_2(c->buf + 5, c->mo = mo);
+    if (y != c->y) {
+        c->y = y;
+        put_2(c->buf, y / 100);
+        put_2(c->buf + 2, y);
+    }
+    return c->buf;
+}
+
+/*
+ * Epoch to civil time without gmtime_r: the day count is split into
+ * 400 year eras and the date read back with the branch light integer
+ * formulas of Howard Hinnant's civil_from_days, months counted from
+ * March so the leap day is the last day of the year.
+ */
+static inline void civil_from_days(int64_t z, int64_t *y, unsigned *m, unsigned *d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    uint32_t doe = (uint32_t)(z - era * 146097);
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = (int64_t)yoe + era * 400 + (*m <= 2);
+}
+
+// floor division of t by a unit, inlined per precision so the divisor is a constant
+static inline int64_t split_unit(int64_t t, int64_t unit, uint32_t *frac) {
+    int64_t q = t / unit, r = t % unit;
+    if (r < 0)
+        r += unit, --q;
+    *frac = (uint32_t)r;
+    return q;
+}
+
+size_t epoch_to_iso8601_p(int64_t t, uint8_t prec, int tz_offset_min, char *out) {
+    static const uint32_t unit[10] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    assert(out && prec <= 9);
+    assert(tz_offset_min > -1440 && tz_offset_min < 1440);
+    uint32_t frac = 0, sod, h, mi;
+    unsigned m, d;
+    int64_t sec, days, y;
+    char *p = out;
+
+    switch (prec) {
+        case 0: sec = t; break;
+        case 3: sec = split_unit(t, 1000, &frac); break;
+        case 6: sec = split_unit(t, 1000000, &frac); break;
+        default: sec = split_unit(t, unit[prec], &frac); break;
+    }
+    days = split_unit(sec, 86400, &sod);
+    sod += tz_offset_min * 60;
+    if ((int32_t)sod < 0)
+        sod += 86400, --days;
+    else if (sod >= 86400)
+        sod -= 86400, ++days;
+    civil_from_days(days, &y, &m, &d);
+
+    if (y >= 0 && y <= 9999) {
+        put_pair(p, y / 100);
+        put_pair(p + 2, y % 100);
+        p += 4;
+    } else {
+        // expanded year, sign and at least 4 digits
+        uint64_t a = y < 0 ? 0 - (uint64_t)y : (uint64_t)y;
+        *p++ = y < 0 ? '-' : '+';
+        for (unsigned n = u64_len(a); n < 4; ++n)
+            *p++ = '0';
+        p = put_u64(p, a);
+    }
+    h = sod / 3600;
+    sod -= h * 3600;
+    mi = sod / 60;
+    p[0] = '-';
+    put_pair(p + 1, m);
+    p[3] = '-';
+    put_pair(p + 4, d);
+    p[6] = 'T';
+    put_pair(p + 7, h);
+    p[9] = ':';
+    put_pair(p + 10, mi);
+    p[12] = ':';
+    put_pair(p + 13, sod - mi * 60);
+    p += 15;
+    if (prec) {
+        *p++ = '.';
+        p = put_u64_n(p, frac, prec);
+    }
+    if (!tz_offset_min) {
+        *p++ = 'Z';
+    } else {
+        unsigned a = tz_offset_min < 0 ? -tz_offset_min : tz_offset_min;
+        *p++ = tz_offset_min < 0 ? '-' : '+';
+        put_pair(p, a / 60);
+        p[2] = ':';
+        put_pair(p + 3, a % 60);
+        p += 5;
+    }
+    *p = 0;
+    return p - out;
+}
+
+size_t epoch_to_iso8601(int64_t ms, int tz_offset_min, char *out) {
+    return epoch_to_iso8601_p(ms, 3, tz_offset_min, out);
+}
+
+/*
+ * Length bounded parsing, 8 ASCII digits are validated and converted at
+ * once as one 64-bit word (SWAR). Returns the number of bytes consumed,
+ * 0 when there is no digit or the value does not fit.
+ */
+
+static inline uint64_t load_u64(const char *s) {
+    uint64_t v;
+    memcpy(&v, s, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t load_u32(const char *s) {
+    uint32_t v;
+    memcpy(&v, s, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+// bytes that are not '0'..'9' have their top bit set
+static inline uint64_t swar_nondigits(uint64_t v) {
+    return ((v - 0x3030303030303030ULL) | (v + 0x4646464646464646ULL)) & 0x8080808080808080ULL;
+}
+
+static inline bool swar_8digits(uint64_t v) {
+    return (((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+            0x3333333333333333ULL);
+}
+
+// first byte is the most significant digit, bytes must be digits or 0
+static inline uint32_t swar_8parse(uint64_t v) {
+    v = ((v & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    v = ((v & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    return (uint32_t)(((v & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32);
+}
+
+size_t xatou2(const char *s, uint32_t *out) {
+    assert(s && out);
+    uint32_t a = (unsigned char)s[0] - '0', b = (unsigned char)s[1] - '0';
+    if (a > 9 || b > 9)
+        return 0;
+    *out = a * 10 + b;
+    return 2;
+}
+
+size_t xatou4(const char *s, uint32_t *out) {
+    assert(s && out);
+    uint32_t v = load_u32(s);
+    if (((v & 0xF0F0F0F0UL) | (((v + 0x06060606UL) & 0xF0F0F0F0UL) >> 4)) != 0x33333333UL)
+        return 0;
+    v = ((v & 0x0F0F0F0FUL) * 2561) >> 8;
+    *out = (((v & 0x00FF00FFUL) * 6553601) >> 16) & 0xFFFF;
+    return 4;
+}
+
+size_t xatou8(const char *s, uint32_t *out) {
+    assert(s && out);
+    uint64_t v = load_u64(s);
+    if (!swar_8digits(v))
+        return 0;
+    *out = swar_8parse(v);
+    return 8;
+}
+
+size_t xatoul(const char *s, size_t len, uint64_t *out) {
+    assert(s && out);
+    const char *p = s, *end = s + len;
+    uint64_t acc = 0;
+    while (end - p >= 8) {
+        uint64_t v = load_u64(p), bad = swar_nondigits(v);
+        unsigned n = 8;
+        if (bad) {
+            n = __builtin_ctzll(bad) >> 3;
+            if (!n)
+                break;
+            v <<= 64 - 8 * n;  // drop the tail, pad in front with zero digits
+        }
+        if (__builtin_mul_overflow(acc, pow10_u64[n], &acc) ||
+            __builtin_add_overflow(acc, swar_8parse(v), &acc))
+            return 0;
+        p += n;
+        if (n < 8)
+            goto done;
+    }
+    for (; p < end; ++p) {
+        uint32_t d = (unsigned char)*p - '0';
+        if (d > 9)
+            break;
+        if (__builtin_mul_overflow(acc, 10, &acc) || __builtin_add_overflow(acc, d, &acc))
+            return 0;
+    }
+done:
+    if (p == s)
+        return 0;
+    *out = acc;
+    return p - s;
+}
+
+size_t xatol(const char *s, size_t len, int64_t *out) {
+    assert(s && out);
+    bool neg = false;
+    size_t sign = 0, n;
+    uint64_t u;
+    if (len && (*s == '-' || *s == '+'))
+        neg = *s == '-', sign = 1;
+    n = xatoul(s + sign, len - sign, &u);
+    if (!n || u > (uint64_t)INT64_MAX + neg)
+        return 0;
+    *out = neg ? (int64_t)(0 - u) : (int64_t)u;
+    return n + sign;
+}
+
+/*
+ * Decimal to double after Eisel and Lemire ("Number Parsing at a
+ * Gigabyte per Second", 2021): up to 19 significant digits are
+ * multiplied by a 128-bit power of five and the top 54 bits rounded,
+ * which is exact for every such input. Longer inputs are tried with
+ * the truncated digits and one above, strtod settles the rare case
+ * where the two disagree.
+ */
+
+static const double pow10_dbl[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// w * 10^q as double bits without sign, w != 0
+static uint64_t eisel_lemire(uint64_t w, int32_t q) {
+    if (q < POW5_128_MIN_Q)
+        return 0;
+    if (q > POW5_128_MAX_Q)
+        return 0x7ffULL << 52;
+    const uint64_t *t = pow5_128[q - POW5_128_MIN_Q];
+    int32_t lz = 64 - bit_len64(w);
+    int32_t exp;
+    uint64_t lo, hi, mant, upper_bit;
+    w <<= lz;
+    lo = w * t[0];
+    hi = mulhi64(w, t[0]);
+    if ((hi & 0x1FF) == 0x1FF) {
+        // top 55 bits not settled yet, add the second word of 5^q
+        uint64_t hi2 = mulhi64(w, t[1]);
+        lo += hi2;
+        hi += hi2 > lo;
+    }
+    upper_bit = hi >> 63;
+    mant = hi >> (upper_bit + 9);
+    lz += 1 ^ upper_bit;
+    exp = ((int32_t)(((152170 + 65536) * (int64_t)q) >> 16)) + 1024 + 63 - lz;
+    if (exp <= 0) {
+        // subnormal
+        if (-exp + 1 >= 64)
+            return 0;
+        mant >>= -exp + 1;
+        mant += mant & 1;
+        mant >>= 1;
+        return mant < (1ULL << 52) ? mant : (1ULL << 52) | (mant & ((1ULL << 52) - 1));
+    }
+    // exactly half way between two doubles, keep it even
+    if (lo <= 1 && q >= -4 && q <= 23 && (mant & 3) == 1 && (mant << (upper_bit + 9)) == hi)
+        mant &= ~1ULL;
+    mant += mant & 1;
+    mant >>= 1;
+    if (mant >= (1ULL << 53))
+        mant = 1ULL << 52, ++exp;
+    if (exp > 2046)
+        return 0x7ffULL << 52;
+    return ((uint64_t)exp << 52) | (mant & ((1ULL << 52) - 1));
+}
+
+static inline bool is_word(const char *p, const char *end, const char *w, size_t n) {
+    if ((size_t)(end - p) < n)
+        return false;
+    for (size_t i = 0; i < n; ++i)
+        if ((p[i] | 0x20) != w[i])
+            return false;
+    return true;
+}
+
+static double strtod_slow(const char *s, size_t len) {
+    char tmp[128], *buf = len < sizeof(tmp) ? tmp : malloc(len + 1);
+    double d;
+    if (!buf)
+        return NAN;
+    memcpy(buf, s, len);
+    buf[len] = 0;
+    d = strtod(buf, 0);
+    if (buf != tmp)
+        free(buf);
+    return d;
+}
+
+size_t xstrtod(const char *s, size_t len, double *out) {
+    assert(s && out);
+    const char *p = s, *end = s + len, *num;
+    uint64_t w = 0, bits;
+    int64_t q = 0;
+    uint32_t nd = 0;
+    bool neg = false, any = false, trunc = false;
+    double d;
+
+    while (p < end && *p == ' ')  // xdtostrf pads with spaces
+        ++p;
+    num = p;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    if (is_word(p, end, "nan", 3)) {
+        *out = neg ? -NAN : NAN;
+        return p + 3 - s;
+    }
+    if (is_word(p, end, "inf", 3)) {
+        p += is_word(p, end, "infinity", 8) ? 8 : 3;
+        *out = neg ? -INFINITY : INFINITY;
+        return p - s;
+    }
+
+    // integer digits, 19 significant ones fit into w
+    while (end - p >= 8 && nd <= 11 && swar_8digits(load_u64(p))) {
+        w = w * 100000000ULL + swar_8parse(load_u64(p));
+        nd = w ? u64_len(w) : 0;
+        p += 8, any = true;
+    }
+    for (; p < end; ++p) {
+        uint32_t c = (unsigned char)*p - '0';
+        if (c > 9)
+            break;
+        any = true;
+        if (nd < 19)
+            w = w * 10 + c, nd += w != 0;
+        else
+            ++q, trunc |= c != 0;
+    }
+    if (p < end && *p == '.') {
+        const char *f = ++p;
+        while (end - p >= 8 && nd <= 11 && swar_8digits(load_u64(p))) {
+            w = w * 100000000ULL + swar_8parse(load_u64(p));
+            nd = w ? u64_len(w) : 0;
+            p += 8, q -= 8;
+        }
+        for (; p < end; ++p) {
+            uint32_t c = (unsigned char)*p - '0';
+            if (c > 9)
+                break;
+            if (nd < 19)
+                w = w * 10 + c, nd += w != 0, --q;
+            else
+                trunc |= c != 0;
+        }
+        any |= p > f;
+    }
+    if (!any)
+        return 0;
+    if (p < end && (*p | 0x20) == 'e') {
+        const char *e = p + 1;
+        bool eneg = false;
+        int64_t ev = 0;
+        if (e < end && (*e == '-' || *e == '+'))
+            eneg = *e++ == '-';
+        if (e < end && (uint32_t)((unsigned char)*e - '0') <= 9) {
+            for (; e < end && (uint32_t)((unsigned char)*e - '0') <= 9; ++e)
+                if (ev < 100000)
+                    ev = ev * 10 + (*e - '0');
+            q += eneg ? -ev : ev;
+            p = e;
+        }
+    }
+
+    if (!w) {
+        d = 0;
+    } else if (!trunc && w <= (1ULL << 53) && q >= -22 && q <= 22) {
+        // both operands exact, one IEEE rounding
+        d = q < 0 ? (double)w / pow10_dbl[-q] : (double)w * pow10_dbl[q];
+    } else {
+        if (q < -400)
+            q = -400;
+        else if (q > 400)
+            q = 400;
+        bits = eisel_lemire(w, (int32_t)q);
+        if (trunc && bits != eisel_lemire(w + 1, (int32_t)q)) {
+            d = strtod_slow(num, p - num);
+            neg = false;
+        } else {
+            memcpy(&d, &bits, sizeof(d));
+        }
+    }
+    *out = neg ? -d : d;
+    return p - s;
 }
@@ -1,4 +1,5 @@
 #include <ctype.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
@@ -11,6 +12,11 @@
 #include <assert.h>
 #include <stdio.h>
 #endif
+#include <errno.h>
+#include <unistd.h>
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #define isset(x) (x)
 #define is_spacing(x) (*(x) == ' ' || *(x) == '\t' || *(x) == '\r' || *(x) == '\n')
@@ -21,80 +27,557 @@
 #define BUFSIZ 512
 #endif
 
-SB *strbf_init(SB *sb) {
+/* growth in percent of the current capacity, 200 doubles */
+#ifndef STRBF_GROW_PCT
+#define STRBF_GROW_PCT 200
+#endif
+#if STRBF_GROW_PCT <= 100
+#error "STRBF_GROW_PCT must be above 100"
+#endif
+
+static void *heap_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  return malloc(size);
+}
+
+static void *heap_realloc(void *ctx, void *ptr, size_t old_size, size_t size) {
+  (void)ctx, (void)old_size;
+  return realloc(ptr, size);
+}
+
+static void heap_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx, (void)size;
+  free(ptr);
+}
+
+static const strbf_alloc_t heap_allocator = {heap_alloc, heap_realloc, heap_free, 0};
+static const strbf_alloc_t *default_alloc = &heap_allocator;
+
+void strbf_set_default_alloc(const strbf_alloc_t *alloc) {
+  default_alloc = alloc ? alloc : &heap_allocator;
+}
+
+/* arena blocks are pointer aligned, only the last one can grow or be given back */
+#define ARENA_ALIGN(x) (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static void *arena_alloc(void *ctx, size_t size) {
+  strbf_arena_t *a = ctx;
+  size_t at = ARENA_ALIGN(a->used);
+  if (at > a->size || a->size - at < size)
+    return 0;
+  a->used = at + size;
+  return a->base + at;
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t old_size, size_t size) {
+  strbf_arena_t *a = ctx;
+  char *p = ptr;
+  if (p + old_size == a->base + a->used) {
+    size_t at = p - a->base;
+    if (a->size - at < size)
+      return 0;
+    a->used = at + size;
+    return p;
+  }
+  if (!(p = arena_alloc(a, size)))
+    return 0;
+  memcpy(p, ptr, old_size < size ? old_size : size);
+  return p;
+}
+
+static void arena_free(void *ctx, void *ptr, size_t size) {
+  strbf_arena_t *a = ctx;
+  if ((char *)ptr + size == a->base + a->used)
+    a->used = (char *)ptr - a->base;
+}
+
+const strbf_alloc_t *strbf_arena_init(strbf_arena_t *arena, void *mem, size_t size) {
+  assert(arena && mem);
+  arena->base = mem;
+  arena->size = size;
+  arena->used = 0;
+  arena->alloc.alloc = arena_alloc;
+  arena->alloc.realloc = arena_realloc;
+  arena->alloc.free = arena_free;
+  arena->alloc.ctx = arena;
+  return &arena->alloc;
+}
+
+void strbf_arena_reset(strbf_arena_t *arena) {
+  assert(arena);
+  arena->used = 0;
+}
+
+/*
+ * Heap buffers hold cap + 1 bytes with end = start + cap, the extra byte
+ * is for the terminating 0. Buffers over caller storage set max = end,
+ * fixed ones from strbf_inits never grow, inline ones (STRBF_F_SPILL)
+ * move to the heap when full.
+ */
+SB *strbf_init_alloc(SB *sb, size_t cap, const strbf_alloc_t *alloc) {
   assert(sb);
-  sb->start = calloc(sizeof(char), BUFSIZ / 2);
+  sb->alloc = alloc ? alloc : default_alloc;
+  sb->start = sb->alloc->alloc(sb->alloc->ctx, cap + 1);
+  if (!sb->start) {
+    sb->cur = sb->end = sb->max = 0;
+    sb->flags = 0;
+    return 0;
+  }
+  *sb->start = 0;
   sb->cur = sb->start;
-  sb->end = sb->start + BUFSIZ / 2 - 1;
+  sb->end = sb->start + cap;
   sb->max = 0;
+  sb->flags = 0;
   return sb;
 }
 
+SB *strbf_init_cap(SB *sb, size_t cap) {
+  return strbf_init_alloc(sb, cap, 0);
+}
+
+SB *strbf_init(SB *sb) {
+  return strbf_init_cap(sb, BUFSIZ / 2 - 1);
+}
+
 SB *strbf_inits(SB *sb, char *str, size_t len) {
-  assert(sb && str);
+  assert(sb && str && len);
   memset(str, 0, len);
   sb->start = str;
   sb->cur = sb->start;
-  sb->end = 0;
-  sb->max = sb->start + len - 1;
+  sb->end = sb->start + len - 1;
+  sb->max = sb->end;
+  sb->alloc = default_alloc;
+  sb->flags = 0;
   return sb;
 }
 
+SB *strbf_init_inline(SB *sb, char *str, size_t len) {
+  assert(sb && str && len);
+  *str = 0;
+  sb->start = str;
+  sb->cur = sb->start;
+  sb->end = sb->start + len - 1;
+  sb->max = sb->end;
+  sb->alloc = default_alloc;
+  sb->flags = STRBF_F_SPILL;
+  return sb;
+}
+
+SB *strbf_init_sso(strbf_sso_t *sso) {
+  assert(sso);
+  return strbf_init_inline(&sso->sb, sso->buf, sizeof(sso->buf));
+}
+
 SB *strbf_reset(SB *sb) {
   assert(sb);
   if (!sb->start)
     strbf_init(sb);
   else {
+    if (sb->flags & STRBF_F_GAP) {
+      strbf_gap_t *g = (strbf_gap_t *)sb;
+      g->gap = 0;
+      g->gap_len = 0;
+      if (g->base + g->headroom <= sb->end)
+        sb->start = g->base + g->headroom;
+    }
+    if (sb->flags & STRBF_F_PATH) {
+      strbf_path_t *p = (strbf_path_t *)sb;
+      p->mark = 0;
+      p->depth = 0;
+      p->partial = 0;
+    }
     memset(sb->start, 0, (sb->max ? sb->max : sb->end) - sb->start);
     sb->cur = sb->start;
   }
   return sb;
 }
 
-/* sb and need may be evaluated multiple times. */
-#define sb_need(sb, need)                                                      \
-  do {                                                                         \
-    if ((sb)->end - (sb)->cur < (need))                                        \
-      sb_grow(sb, need);                                                       \
-  } while (0)
+/*
+    rope, strbf_t over the tail chunk, growing links a new chunk
+*/
 
-static void sb_grow(SB *sb, size_t need) {
-  assert(sb && sb->start);
-  assert(!sb->max || sb->max - sb->cur > need);
-  if (sb->max)
-    return;
-  size_t length = sb->cur - sb->start;
-  size_t alloc = sb->end - sb->start;
+// data follows the header in the same allocation
+#define chunk_data(c) ((char *)((c) + 1))
+
+static strbf_chunk_t *rope_chunk(strbf_rope_t *rope, size_t cap) {
+  strbf_chunk_t *c;
+  const strbf_alloc_t *a = rope->sb.alloc;
+  if (cap == rope->chunk_size && rope->spare) {
+    c = rope->spare;
+    rope->spare = c->next;
+  } else if ((c = a->alloc(a->ctx, sizeof(*c) + cap + 1))) {
+    c->cap = cap;
+  } else {
+    return 0;
+  }
+  c->next = 0;
+  c->len = 0;
+  return c;
+}
+
+static void rope_chunk_free(strbf_rope_t *rope, strbf_chunk_t *c) {
+  const strbf_alloc_t *a = rope->sb.alloc;
+  a->free(a->ctx, c, sizeof(*c) + c->cap + 1);
+}
 
-  do {
-    alloc *= 2;
-  } while (alloc < length + need);
+static void rope_use(strbf_rope_t *rope, strbf_chunk_t *c) {
+  rope->tail = c;
+  rope->sb.start = rope->sb.cur = chunk_data(c);
+  rope->sb.end = rope->sb.max = chunk_data(c) + c->cap;
+}
+
+// close the tail chunk and continue in a new one with room for need
+static int rope_next(strbf_rope_t *rope, size_t need) {
+  strbf_chunk_t *c = rope_chunk(rope, need > rope->chunk_size ? need : rope->chunk_size);
+  if (!c)
+    return -1;
+  rope->tail->len = rope->sb.cur - rope->sb.start;
+  rope->len += rope->tail->len;
+  rope->tail->next = c;
+  rope_use(rope, c);
+  return 0;
+}
+
+SB *strbf_rope_init(strbf_rope_t *rope, size_t chunk_size, const strbf_alloc_t *alloc) {
+  assert(rope && chunk_size);
+  rope->sb.alloc = alloc ? alloc : default_alloc;
+  rope->sb.flags = STRBF_F_ROPE;
+  rope->spare = 0;
+  rope->chunk_size = chunk_size;
+  rope->len = 0;
+  if (!(rope->head = rope_chunk(rope, chunk_size)))
+    return 0;
+  rope_use(rope, rope->head);
+  return &rope->sb;
+}
+
+const strbf_chunk_t *strbf_rope_chunks(strbf_rope_t *rope) {
+  assert(rope && rope->head);
+  rope->tail->len = rope->sb.cur - rope->sb.start;
+  return rope->head;
+}
+
+const char *strbf_chunk_data(const strbf_chunk_t *chunk) {
+  assert(chunk);
+  return (const char *)(chunk + 1);
+}
+
+size_t strbf_rope_len(const strbf_rope_t *rope) {
+  assert(rope);
+  return rope->len + (rope->sb.cur - rope->sb.start);
+}
+
+void strbf_rope_reset(strbf_rope_t *rope) {
+  assert(rope && rope->head);
+  strbf_chunk_t *c = rope->head->next, *next;
+  for (; c; c = next) {
+    next = c->next;
+    if (c->cap == rope->chunk_size) {
+      c->next = rope->spare;
+      rope->spare = c;
+    } else {
+      rope_chunk_free(rope, c);
+    }
+  }
+  rope->head->next = 0;
+  rope->len = 0;
+  rope_use(rope, rope->head);
+}
+
+void strbf_rope_free(strbf_rope_t *rope) {
+  assert(rope);
+  strbf_chunk_t *c, *next;
+  if (rope->head)
+    strbf_rope_reset(rope);
+  for (c = rope->head; c; c = next)
+    next = c->next, rope_chunk_free(rope, c);
+  for (c = rope->spare; c; c = next)
+    next = c->next, rope_chunk_free(rope, c);
+  rope->head = rope->tail = rope->spare = 0;
+  rope->sb.start = rope->sb.cur = rope->sb.end = rope->sb.max = 0;
+}
+
+// all of len bytes, retries short writes
+static int write_fd(int fd, const char *p, size_t len) {
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+int strbf_rope_flush_fd(strbf_rope_t *rope, int fd) {
+  const strbf_chunk_t *c;
+  for (c = strbf_rope_chunks(rope); c; c = c->next)
+    if (write_fd(fd, chunk_data(c), c->len))
+      return -1;
+  strbf_rope_reset(rope);
+  return 0;
+}
+
+int strbf_rope_flush_file(strbf_rope_t *rope, FILE *f) {
+  const strbf_chunk_t *c;
+  for (c = strbf_rope_chunks(rope); c; c = c->next)
+    if (c->len && fwrite(chunk_data(c), 1, c->len, f) != c->len)
+      return -1;
+  strbf_rope_reset(rope);
+  return 0;
+}
+
+/*
+    sink, a fixed buffer that flushes instead of growing
+*/
+
+SB *strbf_init_sink(strbf_sink_t *sink, char *buf, size_t cap, strbf_flush_fn flush, void *ctx) {
+  assert(sink && flush);
+  strbf_inits(&sink->sb, buf, cap);
+  sink->sb.flags = STRBF_F_SINK;
+  sink->flush = flush;
+  sink->ctx = ctx;
+  return &sink->sb;
+}
+
+int strbf_sink_flush(strbf_sink_t *sink) {
+  assert(sink && sink->sb.start);
+  size_t len = sink->sb.cur - sink->sb.start;
+  if (len && sink->flush(sink->ctx, sink->sb.start, len))
+    return -1;
+  sink->sb.cur = sink->sb.start;
+  return 0;
+}
+
+int strbf_sink_fd(void *ctx, const char *data, size_t len) {
+  return write_fd((int)(intptr_t)ctx, data, len);
+}
+
+int strbf_sink_file(void *ctx, const char *data, size_t len) {
+  return fwrite(data, 1, len, ctx) == len ? 0 : -1;
+}
+
+// rest of an append longer than the sink, sb_need has flushed already
+static int sink_put(SB *sb, const char *bytes, size_t count) {
+  for (;;) {
+    size_t n = sb->end - sb->cur;
+    if (n > count)
+      n = count;
+    memcpy(sb->cur, bytes, n);
+    sb->cur += n;
+    if (!(count -= n))
+      return 0;
+    bytes += n;
+    if (strbf_sink_flush((strbf_sink_t *)sb))
+      return -1;
+  }
+}
+
+/* content changed outside the path calls, separator offsets of a path
+ * buffer no longer match any length */
+#define sb_edit(sb) \
+  ((sb)->flags & STRBF_F_PATH ? (void)(((strbf_path_t *)(sb))->mark = STRBF_NPOS) : (void)0)
+
+/* true when need more bytes fit, sb and need may be evaluated multiple times.
+ * Appends reserve here first, so this counts as an edit. */
+#define sb_need(sb, need) \
+  (sb_edit(sb), (size_t)((sb)->end - (sb)->cur) >= (size_t)(need) || sb_grow(sb, need) == 0)
 
-  // sb->start = (char*) realloc(sb->start, alloc + 1);
-  char *data = calloc(sizeof(char), (int)alloc + 1);
-  memcpy(data, sb->start, length);
-  free(sb->start);
+static int sb_resize(SB *sb, size_t alloc) {
+  size_t length = sb->cur - sb->start;
+  char *data;
+  if (sb->flags & STRBF_F_GAP) {
+    // headroom and gap keep their place relative to start
+    strbf_gap_t *g = (strbf_gap_t *)sb;
+    size_t head = sb->start - g->base;
+    if (!(data = sb->alloc->realloc(sb->alloc->ctx, g->base, sb->end - g->base + 1, head + alloc + 1)))
+      return -1;
+    if (g->gap)
+      g->gap = data + head + (g->gap - sb->start);
+    g->base = data;
+    data += head;
+  } else if (sb->max) {
+    // leave caller storage for the heap
+    if (!(sb->flags & STRBF_F_SPILL) || !(data = sb->alloc->alloc(sb->alloc->ctx, alloc + 1)))
+      return -1;
+    memcpy(data, sb->start, length);
+    sb->max = 0;
+    sb->flags &= ~STRBF_F_SPILL;
+  } else if (!(data = sb->alloc->realloc(sb->alloc->ctx, sb->start, sb->end - sb->start + 1, alloc + 1))) {
+    return -1;
+  }
   sb->start = data;
   sb->cur = sb->start + length;
   sb->end = sb->start + alloc;
+  return 0;
 }
 
-void strbf_put(SB *sb, const char *bytes, size_t count) {
+static int sb_grow(SB *sb, size_t need) {
   assert(sb && sb->start);
-  if (bytes && count) {
-    sb_need(sb, count);
-    memcpy(sb->cur, bytes, count);
-    sb->cur += count;
+  if (sb->flags & STRBF_F_ROPE)
+    return rope_next((strbf_rope_t *)sb, need);
+  if (sb->flags & STRBF_F_SINK)
+    return strbf_sink_flush((strbf_sink_t *)sb) || need > (size_t)(sb->end - sb->start) ? -1 : 0;
+  size_t length = sb->cur - sb->start;
+  size_t alloc = sb->end - sb->start;
+
+  alloc = alloc / 100 * STRBF_GROW_PCT + alloc % 100 * STRBF_GROW_PCT / 100;
+  if (alloc < length + need)
+    alloc = length + need;
+  return sb_resize(sb, alloc);
+}
+
+/*
+    gap buffer, headroom before start and a gap that follows inserts
+*/
+
+#define GAP_MIN 64
+
+SB *strbf_init_gap(strbf_gap_t *g, size_t cap, size_t headroom) {
+  assert(g);
+  const strbf_alloc_t *a = default_alloc;
+  g->gap = 0;
+  g->gap_len = 0;
+  g->headroom = headroom;
+  g->sb.alloc = a;
+  g->sb.max = 0;
+  g->sb.flags = STRBF_F_GAP;
+  if (!(g->base = a->alloc(a->ctx, headroom + cap + 1))) {
+    g->sb.start = g->sb.cur = g->sb.end = 0;
+    return 0;
   }
+  g->sb.start = g->sb.cur = g->base + headroom;
+  g->sb.end = g->sb.start + cap;
+  *g->sb.start = 0;
+  return &g->sb;
 }
 
-void strbf_putu(SB *sb, const uint8_t *bytes, size_t count) {
+// content after the gap moves down, contiguous again
+static void gap_close(strbf_gap_t *g) {
+  if (g->gap) {
+    char *from = g->gap + g->gap_len;
+    memmove(g->gap, from, g->sb.cur - from);
+    g->sb.cur -= g->gap_len;
+    g->gap = 0;
+    g->gap_len = 0;
+  }
+}
+
+/* functions that read the content as one block call this first */
+static void sb_flat(SB *sb) {
+  if (sb->flags & STRBF_F_GAP)
+    gap_close((strbf_gap_t *)sb);
+}
+
+// byte at offset i of the content, gap skipped
+static char sb_char(const SB *sb, size_t i) {
+  const char *p = sb->start + i;
+  if (sb->flags & STRBF_F_GAP) {
+    const strbf_gap_t *g = (const strbf_gap_t *)sb;
+    if (g->gap && p >= g->gap)
+      p += g->gap_len;
+  }
+  return *p;
+}
+
+// new block with headroom for count more bytes, headroom grows with the content
+static int gap_relayout(strbf_gap_t *g, size_t count) {
+  SB *sb = &g->sb;
+  const strbf_alloc_t *a = sb->alloc;
+  gap_close(g);
+  size_t len = sb->cur - sb->start, tail = sb->end - sb->cur;
+  size_t head = len / 100 * (STRBF_GROW_PCT - 100) + len % 100 * (STRBF_GROW_PCT - 100) / 100;
+  char *base;
+  head = count + (head > g->headroom ? head : g->headroom);
+  if (!(base = a->alloc(a->ctx, head + len + tail + 1)))
+    return -1;
+  memcpy(base + head, sb->start, len);
+  a->free(a->ctx, g->base, sb->end - g->base + 1);
+  g->base = base;
+  sb->start = base + head;
+  sb->cur = sb->start + len;
+  sb->end = sb->cur + tail;
+  return 0;
+}
+
+static int gap_insert(strbf_gap_t *g, const char *str, size_t at, size_t count) {
+  SB *sb = &g->sb;
+  size_t len = sb->cur - sb->start - g->gap_len, pos;
+  assert(at <= len);
+  if (at == len)
+    return strbf_put(sb, str, count);
+  if (!at) {
+    if ((size_t)(sb->start - g->base) < count && gap_relayout(g, count))
+      return -1;
+    sb->start -= count;
+    memcpy(sb->start, str, count);
+    return 0;
+  }
+  if (g->gap && g->gap_len >= count) {
+    // slide the gap over the bytes between it and at
+    pos = g->gap - sb->start;
+    if (at < pos)
+      memmove(g->gap + g->gap_len - (pos - at), sb->start + at, pos - at);
+    else if (at > pos)
+      memmove(g->gap, g->gap + g->gap_len, at - pos);
+    g->gap = sb->start + at;
+  } else {
+    // open a gap at at, sized to the content so later inserts fit
+    size_t size = count + (len / 8 > GAP_MIN ? len / 8 : GAP_MIN);
+    gap_close(g);
+    if (!sb_need(sb, size))
+      return -1;
+    memmove(sb->start + at + size, sb->start + at, len - at);
+    sb->cur += size;
+    g->gap = sb->start + at;
+    g->gap_len = size;
+  }
+  memcpy(g->gap, str, count);
+  g->gap += count;
+  if (!(g->gap_len -= count))
+    g->gap = 0;
+  return 0;
+}
+
+int strbf_need(SB *sb, size_t len) {
+  assert(sb && sb->start);
+  return sb_need(sb, len) ? 0 : -1;
+}
+
+int strbf_reserve(SB *sb, size_t cap) {
+  assert(sb && sb->start);
+  if ((size_t)(sb->end - sb->start) >= cap)
+    return 0;
+  return sb_resize(sb, cap);
+}
+
+int strbf_shrink_to_fit(SB *sb) {
+  assert(sb && sb->start);
+  if (sb->max || sb->cur == sb->end)
+    return 0;
+  return sb_resize(sb, sb->cur - sb->start);
+}
+
+size_t strbf_cap(const SB *sb) {
+  assert(sb && sb->start);
+  return sb->end - sb->start;
+}
+
+int strbf_put(SB *sb, const char *bytes, size_t count) {
   assert(sb && sb->start);
   if (bytes && count) {
-    sb_need(sb, count);
+    if (!sb_need(sb, count))
+      return sb->flags & STRBF_F_SINK && sb->cur == sb->start ? sink_put(sb, bytes, count) : -1;
     memcpy(sb->cur, bytes, count);
     sb->cur += count;
   }
+  return 0;
+}
+
+int strbf_putu(SB *sb, const uint8_t *bytes, size_t count) {
+  return strbf_put(sb, (const char *)bytes, count);
 }
 
 /*
@@ -105,11 +588,12 @@ void strbf_putu(SB *sb, const uint8_t *bytes, size_t count) {
     } while (0)
 */
 
-void strbf_putc(SB *sb, const char c) {
+int strbf_putc(SB *sb, const char c) {
   assert(sb && sb->start);
-  if (sb->cur >= sb->end)
-    sb_grow(sb, 1);
+  if (!sb_need(sb, 1))
+    return -1;
   *sb->cur++ = c;
+  return 0;
 }
 
 SB *strbf_puts(SB *sb, const char *str) {
@@ -118,71 +602,705 @@ SB *strbf_puts(SB *sb, const char *str) {
   return sb;
 }
 
+int strbf_putv(SB *sb, const strbf_seg_t *segs, size_t n) {
+  assert(sb && sb->start && (segs || !n));
+  size_t i, total = 0;
+  for (i = 0; i < n; ++i)
+    if (segs[i].str)
+      total += segs[i].len;
+  if (!sb_need(sb, total)) {
+    if (!(sb->flags & STRBF_F_SINK) || sb->cur != sb->start)
+      return -1;
+    // more than a sink holds, pieces go through as they fit
+    for (i = 0; i < n; ++i)
+      if (strbf_put(sb, segs[i].str, segs[i].len))
+        return -1;
+    return 0;
+  }
+  for (i = 0; i < n; ++i) {
+    if (segs[i].str) {
+      memcpy(sb->cur, segs[i].str, segs[i].len);
+      sb->cur += segs[i].len;
+    }
+  }
+  return 0;
+}
+
+// length of the next count strings plus extra for each, ap is not advanced
+static size_t va_strlen(va_list ap, int count, size_t extra) {
+  size_t total = 0;
+  const char *str;
+  va_list cp;
+  va_copy(cp, ap);
+  while (count-- > 0)
+    if ((str = va_arg(cp, const char *)))
+      total += strlen(str) + extra;
+  va_end(cp);
+  return total;
+}
+
 SB *strbf_puts_v(SB *sb, int argc, ...) {
-  assert(sb);
+  assert(sb && sb->start);
+  sb_edit(sb);
   va_list ptr;
+  size_t len;
+  int i;
   va_start(ptr, argc);
-  const char *str = 0;
-  register int i = 0;
-  for (; i < argc; ++i) {
-    str = va_arg(ptr, const char *);
-    strbf_puts(sb, str);
+  for (i = 0; i < argc; ++i) {
+    const char *str = va_arg(ptr, const char *);
+    if (!str)
+      continue;
+    len = strlen(str);
+    if ((size_t)(sb->end - sb->cur) < len) {
+      // rope chunks and sinks stay bounded, the rest goes piece by piece
+      if (sb->flags & (STRBF_F_ROPE | STRBF_F_SINK)) {
+        if (strbf_put(sb, str, len))
+          break;
+        continue;
+      }
+      // first miss sizes the rest, the buffer grows once per call
+      if (!sb_need(sb, len + va_strlen(ptr, argc - i - 1, 0)))
+        break;
+    }
+    memcpy(sb->cur, str, len);
+    sb->cur += len;
   }
+  va_end(ptr);
   return sb;
 }
 
+static char *put_hex(char *p, unsigned long long v, int upper) {
+  const char *hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  char t[16], *q = t + sizeof(t);
+  do
+    *--q = hex[v & 15];
+  while (v >>= 4);
+  memcpy(p, q, t + sizeof(t) - q);
+  return p + (t + sizeof(t) - q);
+}
+
+// len bytes of str padded to width, zero padding goes after the sign
+static char *put_pad(char *p, const char *str, size_t len, unsigned width, int left, int zero) {
+  size_t pad = width > len ? width - len : 0;
+  if (!left) {
+    if (zero && len && *str == '-')
+      *p++ = *str++, --len;
+    memset(p, zero ? '0' : ' ', pad);
+    p += pad;
+  }
+  memcpy(p, str, len);
+  p += len;
+  if (left) {
+    memset(p, ' ', pad);
+    p += pad;
+  }
+  return p;
+}
+
+// n copies of c through a sink, flushed as it fills
+static int sink_fill(SB *sb, char c, size_t n) {
+  while (n) {
+    size_t k = sb->end - sb->cur;
+    if (k > n)
+      k = n;
+    memset(sb->cur, c, k);
+    sb->cur += k;
+    if ((n -= k) && strbf_sink_flush((strbf_sink_t *)sb))
+      return -1;
+  }
+  return 0;
+}
+
+static int put_padded(SB *sb, const char *str, size_t len, unsigned width, int left, int zero) {
+  size_t pad = width > len ? width - len : 0;
+  if (sb_need(sb, len + pad)) {
+    sb->cur = put_pad(sb->cur, str, len, width, left, zero);
+    return 0;
+  }
+  // more than a sink holds, padding and text go through as they fit
+  if (!(sb->flags & STRBF_F_SINK) || sb->cur != sb->start)
+    return -1;
+  if (!left) {
+    if (zero && len && *str == '-') {
+      if (strbf_putc(sb, '-'))
+        return -1;
+      ++str, --len;
+    }
+    if (sink_fill(sb, zero ? '0' : ' ', pad))
+      return -1;
+  }
+  if (strbf_put(sb, str, len))
+    return -1;
+  return left ? sink_fill(sb, ' ', pad) : 0;
+}
+
+// %f outside the fixed-precision engine range, nan, inf and |val| >= 1e19
+static int put_f_libc(SB *sb, double val, unsigned width, int prec, int left, int zero) {
+  char f[8], *p = f;
+  *p++ = '%';
+  if (left)
+    *p++ = '-';
+  if (zero)
+    *p++ = '0';
+  memcpy(p, "*.*f", 5);
+  int len = snprintf(0, 0, f, (int)width, prec, val);
+  if (len < 0 || !sb_need(sb, (size_t)len))
+    return -1;
+  snprintf(sb->cur, len + 1, f, (int)width, prec, val);
+  sb->cur += len;
+  return 0;
+}
+
+/*
+ * One pass over fmt, conversions are written straight into the buffer
+ * with the numstr kernels. The first conversion not handled here hands
+ * the rest of fmt and the remaining arguments to vsnprintf.
+ */
+int strbf_vsprintf(SB *sb, const char *fmt, va_list ap) {
+  assert(sb && sb->start && fmt);
+  size_t mark = sb->cur - sb->start, len;
+  char t[32];
+  const char *s, *spec, *str;
+  while (*fmt) {
+    for (s = fmt; *s && *s != '%'; ++s)
+      ;
+    if (s > fmt && strbf_put(sb, fmt, s - fmt))
+      goto fail;
+    if (!*s)
+      break;
+    spec = s++;
+    int left = 0, zero = 0, lng = 0, prec = -1;
+    unsigned width = 0;
+    for (;; ++s) {
+      if (*s == '-')
+        left = 1;
+      else if (*s == '0')
+        zero = 1;
+      else
+        break;
+    }
+    while (*s >= '0' && *s <= '9')
+      width = width * 10 + (*s++ - '0');
+    if (*s == '.') {
+      for (prec = 0, ++s; *s >= '0' && *s <= '9'; ++s)
+        prec = prec * 10 + (*s - '0');
+    }
+    for (; *s == 'l' && lng < 2; ++s)
+      ++lng;
+    str = t;
+    switch (*s) {
+    case '%':
+      if (s != spec + 1)
+        goto fallback;
+      t[0] = '%', len = 1;
+      break;
+    case 'd':
+    case 'i':
+      if (prec >= 0)
+        goto fallback;
+      if (lng == 2)
+        len = xlltoa(va_arg(ap, long long), t);
+      else
+        len = xltoa(lng ? va_arg(ap, long) : va_arg(ap, int), t);
+      break;
+    case 'u':
+      if (prec >= 0)
+        goto fallback;
+      if (lng == 2)
+        len = xulltoa(va_arg(ap, unsigned long long), t);
+      else
+        len = xultoa(lng ? va_arg(ap, unsigned long) : va_arg(ap, unsigned), t);
+      break;
+    case 'x':
+    case 'X':
+      if (prec >= 0)
+        goto fallback;
+      len = put_hex(t, lng == 2 ? va_arg(ap, unsigned long long) : lng ? va_arg(ap, unsigned long) : va_arg(ap, unsigned), *s == 'X') - t;
+      break;
+    case 'c':
+      if (lng)
+        goto fallback;
+      t[0] = (char)va_arg(ap, int), len = 1, zero = 0;
+      break;
+    case 's':
+      if (lng)
+        goto fallback;
+      if (!(str = va_arg(ap, const char *)))
+        str = "(null)";
+      len = prec >= 0 ? strnlen(str, prec) : strlen(str);
+      zero = 0;
+      break;
+    case 'f': {
+      if (lng > 1 || prec > 10)
+        goto fallback;
+      double val = va_arg(ap, double);
+      if (prec < 0)
+        prec = 6;
+      if (!(val > -1e19 && val < 1e19)) {
+        if (put_f_libc(sb, val, width, prec, left, zero))
+          goto fail;
+        fmt = s + 1;
+        continue;
+      }
+      len = 0;
+      if (signbit(val))
+        t[len++] = '-', val = -val;
+      len += f_to_char(val, t + len, prec);
+      break;
+    }
+    default:
+      goto fallback;
+    }
+    if (put_padded(sb, str, len, width, left, zero))
+      goto fail;
+    fmt = s + 1;
+  }
+  return 0;
+
+fallback: {
+    va_list cp;
+    va_copy(cp, ap);
+    int n = vsnprintf(0, 0, spec, cp);
+    va_end(cp);
+    if (n < 0)
+      goto fail;
+    if (!sb_need(sb, (size_t)n)) {
+      // more than a sink holds, formatted aside and passed on in pieces
+      char *tmp;
+      int ret;
+      if (!(sb->flags & STRBF_F_SINK) || sb->cur != sb->start || !(tmp = sb->alloc->alloc(sb->alloc->ctx, n + 1)))
+        goto fail;
+      vsnprintf(tmp, n + 1, spec, ap);
+      ret = strbf_put(sb, tmp, n);
+      sb->alloc->free(sb->alloc->ctx, tmp, n + 1);
+      return ret;
+    }
+    vsnprintf(sb->cur, n + 1, spec, ap);
+    sb->cur += n;
+    return 0;
+  }
+fail:
+  // output already moved to other chunks or flushed stays
+  if (!(sb->flags & (STRBF_F_ROPE | STRBF_F_SINK)))
+    sb->cur = sb->start + mark;
+  return -1;
+}
+
+/*
+ * Compiled formats: literal runs and typed conversions with their
+ * worst-case width, one growth check per record, no parsing at exec.
+ */
+
+// longest %.10f below 1e19 is 1 + 19 + 1 + 10, libc prints the rest
+#define FMT_F_LIBC_MAX 330
+
+static uint16_t fmt_int_max(uint8_t type, int hex) {
+  size_t size = type == STRBF_FMT_I || type == STRBF_FMT_U ? sizeof(int)
+                : type == STRBF_FMT_L || type == STRBF_FMT_UL ? sizeof(long)
+                : sizeof(long long);
+  if (hex)
+    return size * 2;
+  // decimal digits of the type, plus the sign for signed ones
+  return (size == 4 ? 10 : 20) + (type < STRBF_FMT_U);
+}
+
+int strbf_fmt_compile(strbf_fmt_t *f, const char *fmt) {
+  assert(f && fmt);
+  const char *s = fmt, *e;
+  strbf_fmt_op_t *op;
+  int args = 0;
+  f->fmt = fmt;
+  f->nops = 0;
+  f->max = 0;
+  while (*s) {
+    if (f->nops == STRBF_FMT_MAX_OPS)
+      return -1;
+    op = &f->ops[f->nops++];
+    memset(op, 0, sizeof(*op));
+    if (*s != '%' || s[1] == '%') {
+      // literal run, "%%" ends it with its first '%'
+      for (e = s; *e && *e != '%' && e - s < UINT16_MAX - 1; ++e)
+        ;
+      op->type = STRBF_FMT_LIT;
+      op->off = s - fmt;
+      op->len = e - s;
+      if (*e == '%' && e[1] == '%')
+        ++op->len, e += 2;
+      f->max += op->len;
+      s = e;
+      continue;
+    }
+    op->prec = -1;
+    for (++s;; ++s) {
+      if (*s == '-')
+        op->flags |= STRBF_FMT_LEFT;
+      else if (*s == '0')
+        op->flags |= STRBF_FMT_ZERO;
+      else
+        break;
+    }
+    for (; *s >= '0' && *s <= '9'; ++s)
+      if ((op->width = op->width * 10 + (*s - '0')) > 1024)
+        return -1;
+    if (*s == '.') {
+      for (op->prec = 0, ++s; *s >= '0' && *s <= '9'; ++s)
+        if ((op->prec = op->prec * 10 + (*s - '0')) > 100)
+          return -1;
+    }
+    int lng = 0;
+    for (; *s == 'l' && lng < 2; ++s)
+      ++lng;
+    switch (*s) {
+    case 'd':
+    case 'i':
+      op->type = STRBF_FMT_I + lng;
+      break;
+    case 'X':
+      op->flags |= STRBF_FMT_UPPER;
+      /* fall through */
+    case 'x':
+      op->flags |= STRBF_FMT_HEX;
+      /* fall through */
+    case 'u':
+      op->type = STRBF_FMT_U + lng;
+      break;
+    case 'c':
+      op->type = lng ? 0 : STRBF_FMT_C;
+      op->len = 1;
+      op->flags &= ~STRBF_FMT_ZERO;
+      break;
+    case 's':
+      // string lengths are added at exec
+      op->type = lng ? 0 : STRBF_FMT_S;
+      op->flags &= ~STRBF_FMT_ZERO;
+      break;
+    case 'f':
+      op->type = lng > 1 ? 0 : STRBF_FMT_F;
+      if (op->prec < 0)
+        op->prec = 6;
+      if (op->prec > 10)
+        op->type = 0;
+      op->len = 20 + (op->prec ? op->prec + 1 : 0);
+      break;
+    default:
+      return -1;
+    }
+    if (op->type == STRBF_FMT_LIT || (op->type != STRBF_FMT_S && op->type != STRBF_FMT_F && op->prec >= 0))
+      return -1;
+    if (op->type <= STRBF_FMT_ULL)
+      op->len = fmt_int_max(op->type, op->flags & STRBF_FMT_HEX);
+    if (op->len < op->width)
+      op->len = op->width;
+    f->max += op->len;
+    ++args;
+    ++s;
+  }
+  return args;
+}
+
+int strbf_fmt_execa(SB *sb, const strbf_fmt_t *f, const strbf_arg_t *args) {
+  assert(sb && sb->start && f);
+  const strbf_fmt_op_t *op, *ops_end = f->ops + f->nops;
+  const strbf_arg_t *a = args;
+  size_t need = f->max, len;
+  char t[32], *p;
+
+  // lengths only known now, strings and %f values libc has to print
+  for (op = f->ops; op < ops_end; ++op) {
+    if (op->type == STRBF_FMT_LIT)
+      continue;
+    if (op->type == STRBF_FMT_S) {
+      len = !a->s ? 6 : op->prec >= 0 ? strnlen(a->s, op->prec) : strlen(a->s);
+      need += len > op->width ? len - op->width : 0;
+    } else if (op->type == STRBF_FMT_F && !(a->f > -1e19 && a->f < 1e19)) {
+      need += FMT_F_LIBC_MAX + op->width;
+    }
+    ++a;
+  }
+  if (!sb_need(sb, need))
+    return -1;
+
+  p = sb->cur;
+  for (op = f->ops, a = args; op < ops_end; ++op) {
+    int left = op->flags & STRBF_FMT_LEFT, zero = op->flags & STRBF_FMT_ZERO;
+    // unpadded conversions go straight to the buffer
+    char *o = op->width ? t : p;
+    const char *str = o;
+    switch (op->type) {
+    case STRBF_FMT_LIT:
+      memcpy(p, f->fmt + op->off, op->len);
+      p += op->len;
+      continue;
+    case STRBF_FMT_I:
+      len = xltoa((int)a->i, o);
+      break;
+    case STRBF_FMT_L:
+      len = xltoa((long)a->i, o);
+      break;
+    case STRBF_FMT_LL:
+      len = xlltoa(a->i, o);
+      break;
+    case STRBF_FMT_U:
+    case STRBF_FMT_UL:
+    case STRBF_FMT_ULL: {
+      unsigned long long v = op->type == STRBF_FMT_U ? (unsigned)a->u : op->type == STRBF_FMT_UL ? (unsigned long)a->u : a->u;
+      if (op->flags & STRBF_FMT_HEX)
+        len = put_hex(o, v, op->flags & STRBF_FMT_UPPER) - o;
+      else
+        len = xulltoa(v, o);
+      break;
+    }
+    case STRBF_FMT_C:
+      o[0] = (char)a->i, len = 1;
+      break;
+    case STRBF_FMT_S:
+      if (!(str = a->s))
+        str = "(null)";
+      len = op->prec >= 0 ? strnlen(str, op->prec) : strlen(str);
+      break;
+    default: {
+      double val = a->f;
+      if (!(val > -1e19 && val < 1e19)) {
+        char fs[8] = "%", *q = fs + 1;
+        if (left)
+          *q++ = '-';
+        if (zero)
+          *q++ = '0';
+        memcpy(q, "*.*f", 5);
+        p += snprintf(p, FMT_F_LIBC_MAX + op->width + 1, fs, (int)op->width, op->prec, val);
+        ++a;
+        continue;
+      }
+      len = 0;
+      if (signbit(val))
+        o[len++] = '-', val = -val;
+      len += f_to_char(val, o + len, op->prec);
+      break;
+    }
+    }
+    p = str == p ? p + len : put_pad(p, str, len, op->width, left, zero);
+    ++a;
+  }
+  sb->cur = p;
+  return 0;
+}
+
+int strbf_fmt_exec(SB *sb, const strbf_fmt_t *f, ...) {
+  strbf_arg_t args[STRBF_FMT_MAX_OPS], *a = args;
+  const strbf_fmt_op_t *op;
+  va_list ptr;
+  va_start(ptr, f);
+  for (op = f->ops; op < f->ops + f->nops; ++op) {
+    switch (op->type) {
+    case STRBF_FMT_LIT:
+      continue;
+    case STRBF_FMT_I:
+    case STRBF_FMT_C:
+      a->i = va_arg(ptr, int);
+      break;
+    case STRBF_FMT_L:
+      a->i = va_arg(ptr, long);
+      break;
+    case STRBF_FMT_LL:
+      a->i = va_arg(ptr, long long);
+      break;
+    case STRBF_FMT_U:
+      a->u = va_arg(ptr, unsigned);
+      break;
+    case STRBF_FMT_UL:
+      a->u = va_arg(ptr, unsigned long);
+      break;
+    case STRBF_FMT_ULL:
+      a->u = va_arg(ptr, unsigned long long);
+      break;
+    case STRBF_FMT_S:
+      a->s = va_arg(ptr, const char *);
+      break;
+    default:
+      a->f = va_arg(ptr, double);
+      break;
+    }
+    ++a;
+  }
+  va_end(ptr);
+  return strbf_fmt_execa(sb, f, args);
+}
+
 SB *strbf_sprintf(SB *sb, const char *fmt, ...) {
   assert(sb);
   va_list ptr;
   va_start(ptr, fmt);
-  size_t len = vsnprintf(0, 0, fmt, ptr); // get the length
-  va_end(ptr);
-  va_start(ptr, fmt);
-  sb_need(sb, len);
-  vsnprintf(sb->cur, len + 1, fmt, ptr);
-  sb->cur += len;
+  strbf_vsprintf(sb, fmt, ptr);
   va_end(ptr);
   return sb;
 }
 
-void strbf_putl(SB *sb, long val) {
-  char i[16] = {0}, *p = i;
-  size_t len = xltoa(val, p);
-  strbf_put(sb, p, len);
+int strbf_putl(SB *sb, long val) {
+  assert(sb && sb->start);
+  if (!sb_need(sb, (val < 0) + xint_len(val < 0 ? 0UL - (unsigned long)val : (unsigned long)val)))
+    return -1;
+  sb->cur += xltoa(val, sb->cur);
+  return 0;
 }
 
-void strbf_putul(SB *sb, uint32_t val) {
-  char i[16] = {0}, *p = i;
-  size_t len = xultoa(val, p);
-  strbf_put(sb, p, len);
+int strbf_putul(SB *sb, uint32_t val) {
+  assert(sb && sb->start);
+  if (!sb_need(sb, xint_len(val)))
+    return -1;
+  sb->cur += uint_to_char(val, sb->cur);
+  return 0;
 }
 
-void strbf_putf(SB *sb, float val) {
-  char i[16] = {0}, *p = i;
-  xftoa(val, p, 16);
-  strbf_put(sb, p, strlen(p));
+int strbf_putll(SB *sb, long long val) {
+  assert(sb && sb->start);
+  if (!sb_need(sb, (val < 0) + xint_len64(val < 0 ? 0ULL - (unsigned long long)val : (unsigned long long)val)))
+    return -1;
+  sb->cur += xlltoa(val, sb->cur);
+  return 0;
 }
 
-void strbf_putd_b(SB *sb, double val, const int8_t width, const uint8_t perc, const uint8_t mark) {
-  char i[16] = {0}, *p = i;
-  xdtostrf_b(val, width,  perc, p, mark);
-  strbf_put(sb, p, strlen(p));
+int strbf_putull(SB *sb, unsigned long long val) {
+  assert(sb && sb->start);
+  if (!sb_need(sb, xint_len64(val)))
+    return -1;
+  sb->cur += xulltoa(val, sb->cur);
+  return 0;
+}
+
+#if defined(__SIZEOF_INT128__)
+int strbf_puti128(SB *sb, __int128 val) {
+  char i[48], *p = i;
+  size_t len = xi128toa(val, p);
+  return strbf_put(sb, p, len);
 }
 
-void strbf_putd(SB *sb, double val, const int8_t width, const uint8_t perc) {
-  strbf_putd_b(sb, val, width, perc, ' ');
+int strbf_putu128(SB *sb, unsigned __int128 val) {
+  char i[48], *p = i;
+  size_t len = xu128toa(val, p);
+  return strbf_put(sb, p, len);
+}
+#endif
+
+int strbf_putf(SB *sb, float val) {
+  char i[XDTOA_SHORTEST_BUFSIZE], *p = i;
+  size_t len = xftoa_shortest(val, p);
+  return strbf_put(sb, p, len);
+}
+
+int strbf_putd_shortest(SB *sb, double val) {
+  char i[XDTOA_SHORTEST_BUFSIZE], *p = i;
+  size_t len = xdtoa_shortest(val, p);
+  return strbf_put(sb, p, len);
+}
+
+// sign, every integer digit of DBL_MAX, point and a uint8_t fraction,
+// width is an int8_t and never more
+#define PUTD_MAX (1 + 309 + 1 + 255)
+
+int strbf_putd_b(SB *sb, double val, const int8_t width, const uint8_t perc, const uint8_t mark) {
+  char i[PUTD_MAX + 1], *p = i;
+  xdtostrf_b(val, width, perc, p, mark);
+  return strbf_put(sb, p, strlen(p));
+}
+
+int strbf_putd(SB *sb, double val, const int8_t width, const uint8_t perc) {
+  return strbf_putd_b(sb, val, width, perc, ' ');
+}
+
+int strbf_put_iso8601(SB *sb, int64_t t, uint8_t prec, int tz_offset_min) {
+  char i[ISO8601_BUFSIZE], *p = i;
+  size_t len = epoch_to_iso8601_p(t, prec, tz_offset_min, p);
+  return strbf_put(sb, p, len);
 }
 
 /*
     path related string manipulations
 */
 
+/*
+ * Separator offsets of strbf_path_t. The offsets cover every separator
+ * from off[0] on while mark matches the length. Other writes set mark to
+ * STRBF_NPOS (sb_edit), a call that finds another length drops them and
+ * pop_path scans until new ones are recorded.
+ */
+
+SB *strbf_init_path(strbf_path_t *p, size_t cap) {
+  assert(p);
+  if (!strbf_init_cap(&p->sb, cap))
+    return 0;
+  p->sb.flags = STRBF_F_PATH;
+  p->mark = 0;
+  p->depth = 0;
+  p->partial = 0;
+  return &p->sb;
+}
+
+// length before a path call, offsets dropped when something else moved it
+static size_t path_begin(SB *sb) {
+  size_t len = sb->cur - sb->start;
+  if (sb->flags & STRBF_F_PATH) {
+    strbf_path_t *p = (strbf_path_t *)sb;
+    if (p->mark != len) {
+      p->depth = 0;
+      p->partial = 1;
+    }
+  }
+  return len;
+}
+
+// record separators written from offset from on
+static void path_sync(SB *sb, size_t from, char sep) {
+  strbf_path_t *p = (strbf_path_t *)sb;
+  size_t i, len;
+  if (!(sb->flags & STRBF_F_PATH))
+    return;
+  len = sb->cur - sb->start;
+  while (p->depth && p->off[p->depth - 1] >= from)
+    --p->depth;
+  for (i = from ? from : 1; i < len; ++i) {
+    const char *q = memchr(sb->start + i, sep, len - i);
+    if (!q)
+      break;
+    i = q - sb->start;
+    if (p->depth == STRBF_PATH_DEPTH) {
+      memmove(p->off, p->off + STRBF_PATH_DEPTH / 2, sizeof(p->off[0]) * (STRBF_PATH_DEPTH - STRBF_PATH_DEPTH / 2));
+      p->depth -= STRBF_PATH_DEPTH / 2;
+      p->partial = 1;
+    }
+    p->off[p->depth++] = i;
+  }
+  p->mark = len;
+}
+
+// pop_path from the offsets, 0 when the caller has to scan
+static int path_pop(SB *sb, char sep) {
+  strbf_path_t *p = (strbf_path_t *)sb;
+  size_t len = path_begin(sb), end, q;
+  end = len && sb->start[len - 1] == sep ? len - 1 : len;
+  while (p->depth && p->off[p->depth - 1] >= end)
+    --p->depth;
+  if (!p->depth)
+    return !p->partial;
+  q = p->off[--p->depth];
+  if (sb->start[q] != sep) {
+    p->depth = 0;
+    p->partial = 1;
+    return 0;
+  }
+  sb->cur = sb->start + q;
+  p->mark = q;
+  return 1;
+}
+
 static SB *_put_pathsep(SB *sb, char sep) {
   assert(sb);
   if (!sep)
     sep = '/';
-  if (sb->start && sb->cur && sb->cur > sb->start && *(sb->cur - 1) != sep)
+  if (sb->start && sb->cur && sb->cur > sb->start && *(sb->cur - 1) != sep) {
+    size_t len = path_begin(sb);
     strbf_putc(sb, sep);
+    path_sync(sb, len, sep);
+  }
   return sb;
 }
 
@@ -201,6 +1319,7 @@ SB *strbf_put_urisep(SB *sb) {
 SB *_put_path(SB *sb, const char *str, char sep) {
   assert(sb);
   if (str) {
+    size_t len = path_begin(sb);
     if (*str == sep) {
       if (sb->cur > sb->start && *(sb->cur - 1) == sep)
         --sb->cur;
@@ -208,6 +1327,7 @@ SB *_put_path(SB *sb, const char *str, char sep) {
       _put_pathsep(sb, sep);
     }
     strbf_puts(sb, str);
+    path_sync(sb, len ? len - 1 : 0, sep);
   }
   return sb;
 }
@@ -215,6 +1335,7 @@ SB *_put_path(SB *sb, const char *str, char sep) {
 SB *_put_path_n(SB *sb, const char *str, char sep, size_t len) {
   assert(sb);
   if (str) {
+    size_t from = path_begin(sb);
     if (*str == sep) {
       if (sb->cur > sb->start && *(sb->cur - 1) == sep)
         --sb->cur;
@@ -222,6 +1343,7 @@ SB *_put_path_n(SB *sb, const char *str, char sep, size_t len) {
       _put_pathsep(sb, sep);
     }
     strbf_put(sb, str, len);
+    path_sync(sb, from ? from - 1 : 0, sep);
   }
   return sb;
 }
@@ -244,46 +1366,134 @@ SB *strbf_put_uri_at(SB *sb, const char *str, size_t len) {
   return strbf_put_uri(sb, str);
 }
 
+/*
+ * Joins components like repeated _put_path: a separator goes between
+ * them unless one is already there, a leading separator on a component
+ * replaces a trailing one. The buffer grows at most once per call.
+ */
+static SB *_put_path_v(SB *sb, char sep, int argc, va_list ap) {
+  assert(sb && sb->start);
+  size_t len, from = path_begin(sb);
+  int i;
+  const char *str;
+  for (i = 0; i < argc; ++i) {
+    if (!(str = va_arg(ap, const char *)))
+      continue;
+    len = strlen(str);
+    if ((size_t)(sb->end - sb->cur) <= len) {
+      // rope chunks and sinks stay bounded, the rest goes piece by piece
+      if (sb->flags & (STRBF_F_ROPE | STRBF_F_SINK)) {
+        _put_path(sb, str, sep);
+        continue;
+      }
+      if (!sb_need(sb, len + 1 + va_strlen(ap, argc - i - 1, 1)))
+        break;
+    }
+    if (sb->cur > sb->start) {
+      if (*str != sep) {
+        if (sb->cur[-1] != sep)
+          *sb->cur++ = sep;
+      } else if (sb->cur[-1] == sep) {
+        ++str, --len;
+      }
+    }
+    memcpy(sb->cur, str, len);
+    sb->cur += len;
+  }
+  path_sync(sb, from ? from - 1 : 0, sep);
+  return sb;
+}
+
 SB *strbf_put_path_v(SB *sb, int argc, ...) {
-  assert(sb);
   va_list ptr;
   va_start(ptr, argc);
-  const char *str = 0;
-  register int i = 0;
-  for (; i < argc; ++i) {
-    str = va_arg(ptr, const char *);
-    strbf_put_path(sb, str);
-  }
+  _put_path_v(sb, '/', argc, ptr);
+  va_end(ptr);
   return sb;
 }
 
 SB *strbf_put_uri_v(SB *sb, int argc, ...) {
-  assert(sb);
   va_list ptr;
   va_start(ptr, argc);
-  const char *str = 0;
-  register int i = 0;
-  for (; i < argc; ++i) {
-    str = va_arg(ptr, const char *);
-    strbf_put_uri(sb, str);
-  }
+  _put_path_v(sb, '/', argc, ptr);
+  va_end(ptr);
   return sb;
 }
 
 static SB *_pop_path(SB *sb, char sep) {
   assert(sb);
   if (sb->cur) {
+    sb_flat(sb);
     if (!sep)
       sep = '/';
-    char *cur = sb->cur - 1;
-    if (cur && *cur == sep) {
+    if (sb->flags & STRBF_F_PATH && path_pop(sb, sep))
+      return sb;
+    char *cur = sb->cur;
+    if (cur > sb->start && *--cur == sep && cur > sb->start)
       --cur;
-    }
-    while (cur && cur > sb->start && *cur != sep)
+    while (cur > sb->start && *cur != sep)
       --cur;
     if (cur > sb->start && *cur == sep) {
       strbf_pop(sb, sb->cur - cur);
     }
+    path_sync(sb, sb->cur - sb->start, sep);
+  }
+  return sb;
+}
+
+/*
+ * One forward pass, the output is never longer than what was read, so it
+ * is written over the input. stop is where ".." stops backing up: after
+ * the root or after leading ".." of a relative path.
+ */
+SB *strbf_path_normalize(SB *sb) {
+  assert(sb && sb->start);
+  const char sep = '/';
+  char *r, *w, *q, *end, *stop;
+  size_t n;
+  int root, up;
+  sb_flat(sb);
+  r = w = sb->start;
+  end = sb->cur;
+  if (r == end)
+    return sb;
+  if ((root = *r == sep))
+    *w++ = *r++;
+  stop = w;
+  for (; r < end; r = q) {
+    if (*r == sep) {
+      q = r + 1;
+      continue;
+    }
+    if (!(q = memchr(r, sep, end - r)))
+      q = end;
+    n = q - r;
+    if (n == 1 && *r == '.')
+      continue;
+    if ((up = n == 2 && r[0] == '.' && r[1] == '.')) {
+      if (w > stop) {
+        while (w > stop && w[-1] != sep)
+          --w;
+        if (w > stop)
+          --w;
+        continue;
+      }
+      if (root)
+        continue;
+    }
+    if (w > sb->start && w[-1] != sep)
+      *w++ = sep;
+    memmove(w, r, n);
+    w += n;
+    if (up)
+      stop = w;
+  }
+  if (w == sb->start)
+    *w++ = '.';
+  sb->cur = w;
+  if (sb->flags & STRBF_F_PATH) {
+    ((strbf_path_t *)sb)->partial = 0;
+    path_sync(sb, 0, sep);
   }
   return sb;
 }
@@ -296,9 +1506,8 @@ static SB *_insert_pathsep(SB *sb, char sep, size_t at) {
   assert(sb);
   if (!sep)
     sep = '/';
-  char *a = sb->start + at;
-  assert(a >= sb->start && a <= sb->cur);
-  if (a > sb->start && *(a - 1) != sep)
+  assert(at <= strbf_len(sb));
+  if (at && sb_char(sb, at - 1) != sep)
     strbf_insertc(sb, sep, at++);
 
   return sb;
@@ -319,20 +1528,16 @@ SB *strbf_insert_urisep(SB *sb, size_t at) {
 static SB *_insert_path(SB *sb, const char *str, size_t at, char sep) {
   assert(sb);
   if (str) {
-    char *a = sb->start + at, *b = a;
-    assert(a >= sb->start && a <= sb->cur);
+    size_t b = at;
+    assert(at <= strbf_len(sb));
     if (*str == sep) {
-      if (a > sb->start && *(a - 1) == sep) {
-        a -= 1;
+      if (at && sb_char(sb, at - 1) == sep)
         --at;
-      }
     } else {
-      if (a > sb->start && *(a) == sep) {
-        a += 1;
+      if (at && sb_char(sb, at) == sep)
         ++at;
-      }
     }
-    if (a != b)
+    if (at != b)
       _insert_pathsep(sb, sep, at);
     strbf_inserts(sb, str, at);
   }
@@ -347,91 +1552,113 @@ SB *strbf_insert_uri(SB *sb, const char *str, size_t at) {
   return _insert_path(sb, str, at, '/');
 }
 
-void strbf_concat(SB *sb, const char *str, size_t count) {
+int strbf_concat(SB *sb, const char *str, size_t count) {
   assert(sb && sb->cur);
-  strbf_put(sb, str, count);
+  int ret = strbf_put(sb, str, count);
   *sb->cur = 0;
+  return ret;
 }
 
-void strbf_concatc(SB *sb, const char c) {
+int strbf_concatc(SB *sb, const char c) {
   assert(sb && sb->cur);
-  strbf_putc(sb, c);
+  int ret = strbf_putc(sb, c);
   *sb->cur = 0;
+  return ret;
 }
 
-void strbf_concats(SB *sb, const char *str) {
+int strbf_concats(SB *sb, const char *str) {
+  int ret = 0;
   if (str) {
     assert(sb && sb->cur);
-    strbf_put(sb, str, strlen(str));
+    ret = strbf_put(sb, str, strlen(str));
     *sb->cur = 0;
   }
+  return ret;
 }
 
-void strbf_insert(SB *sb, const char *str, size_t after, size_t count) {
+int strbf_insert(SB *sb, const char *str, size_t after, size_t count) {
   if (str) {
     assert(sb && sb->cur);
     if (!count)
       count = strlen(str);
-    sb_need(sb, count);
+    if (sb->flags & STRBF_F_GAP)
+      return gap_insert((strbf_gap_t *)sb, str, after, count);
+    if (!sb_need(sb, count))
+      return -1;
     memmove(sb->start + after + count, sb->start + after,
-            sb->cur - sb->start + after);
+            sb->cur - sb->start - after);
     memcpy(sb->start + after, str, count);
     sb->cur += count;
     //*sb->cur=0;
   }
+  return 0;
 }
 
-void strbf_insertc(SB *sb, const char str, size_t after) {
+int strbf_insertc(SB *sb, const char str, size_t after) {
   if (str) {
     assert(sb && sb->cur);
-    if (sb->cur >= sb->end)
-      sb_grow(sb, 1);
+    if (sb->flags & STRBF_F_GAP)
+      return gap_insert((strbf_gap_t *)sb, &str, after, 1);
+    if (!sb_need(sb, 1))
+      return -1;
     memmove(sb->start + after + 1, sb->start + after,
-            sb->cur - sb->start + after);
+            sb->cur - sb->start - after);
     *(sb->start + after) = str;
     sb->cur += 1;
     //*sb->cur=0;
   }
+  return 0;
 }
 
-void strbf_inserts(SB *sb, const char *str, size_t after) {
+int strbf_inserts(SB *sb, const char *str, size_t after) {
   if (str) {
-    strbf_insert(sb, str, after, strlen(str));
+    return strbf_insert(sb, str, after, strlen(str));
   }
+  return 0;
 }
 
-void strbf_prepend(SB *sb, const char *str, size_t count) {
+int strbf_prepend(SB *sb, const char *str, size_t count) {
   if (str) {
     assert(sb && sb->cur);
     if (!count)
       count = strlen(str);
-    sb_need(sb, count);
+    if (sb->flags & STRBF_F_GAP)
+      return gap_insert((strbf_gap_t *)sb, str, 0, count);
+    if (!sb_need(sb, count))
+      return -1;
     memmove(sb->start + count, sb->start, sb->cur - sb->start);
     memcpy(sb->start, str, count);
     sb->cur += count;
     //*sb->cur=0;
   }
+  return 0;
 }
 
-void strbf_prependc(SB *sb, const char c) {
+int strbf_prependc(SB *sb, const char c) {
   assert(sb && sb->start);
-  if (sb->cur >= sb->end)
-    sb_grow(sb, 1);
+  if (sb->flags & STRBF_F_GAP)
+    return gap_insert((strbf_gap_t *)sb, &c, 0, 1);
+  if (!sb_need(sb, 1))
+    return -1;
   memmove(sb->start + 1, sb->start, sb->cur - sb->start);
   *sb->start = c;
   sb->cur += 1;
   //*sb->cur=0;
+  return 0;
 }
 
-void strbf_prepends(SB *sb, const char *str) {
+int strbf_prepends(SB *sb, const char *str) {
   if (str) {
-    strbf_prepend(sb, str, strlen(str));
+    return strbf_prepend(sb, str, strlen(str));
   }
+  return 0;
 }
 
 void strbf_shift(SB *sb, size_t count) {
   if (count) {
     assert(sb && sb->start);
+    sb_flat(sb);
+    sb_edit(sb);
     memmove(sb->start, sb->start + count, sb->cur - sb->start - count);
     sb->cur -= count;
   }
@@ -440,37 +1667,902 @@ void strbf_shift(SB *sb, size_t count) {
 void strbf_pop(SB *sb, size_t count) {
   if (count) {
     assert(sb && sb->start);
+    sb_flat(sb);
+    sb_edit(sb);
     sb->cur -= count;
   }
 }
 
 strbf_t *strbf_shape(SB *sb, size_t count) {
     assert(sb && sb->start);
+    sb_flat(sb);
+    sb_edit(sb);
     sb->cur = sb->start + count;
     *sb->cur = 0;
   return sb;
 }
 
+/*
+    byte scanning, character classes and substring search, a vector or a
+    machine word of bytes is compared at once
+*/
+
+/* sets up to this length take the block kernels, longer ones the bitmap */
+#define CLS_VEC 8
+
+typedef struct {
+  uint32_t map[8];
+  const char *set;
+  size_t n;
+} cls_t;
+
+#define cls_has(cl, c) ((cl)->map[(uint8_t)(c) >> 5] >> ((uint8_t)(c) & 31) & 1)
+
+static void cls_init(cls_t *cl, const char *set) {
+  memset(cl->map, 0, sizeof(cl->map));
+  cl->set = set;
+  for (cl->n = 0; set[cl->n]; ++cl->n)
+    cl->map[(uint8_t)set[cl->n] >> 5] |= 1U << ((uint8_t)set[cl->n] & 31);
+}
+
+typedef size_t (*cls_scan_fn)(const char *s, size_t len, const cls_t *cl, int in);
+
+// bytes from the front (fwd) or back (rev) whose membership equals in
+static inline size_t scan_fwd_scalar(const char *s, size_t len, const cls_t *cl, int in) {
+  size_t i = 0;
+  while (i < len && (int)cls_has(cl, s[i]) == in)
+    ++i;
+  return i;
+}
+
+static inline size_t scan_rev_scalar(const char *s, size_t len, const cls_t *cl, int in) {
+  size_t i = len;
+  while (i && (int)cls_has(cl, s[i - 1]) == in)
+    --i;
+  return len - i;
+}
+
+/*
+ * Block kernels. MASK gives 1 << SH bits per byte of a W byte block, set
+ * for bytes in the class, FULL is the mask with every byte in. The scalar
+ * loop finishes the bytes that do not fill a block.
+ */
+#define CLS_SCAN(isa, W, SH, FULL, VT, SET1, MASK, ATTR)                                \
+  ATTR static size_t scan_fwd_##isa(const char *s, size_t len, const cls_t *cl, int in) { \
+    VT bc[CLS_VEC];                                                                     \
+    uint64_t flip = in ? (FULL) : 0, m;                                                 \
+    size_t i, k;                                                                        \
+    for (k = 0; k < cl->n; ++k)                                                         \
+      bc[k] = SET1(cl->set[k]);                                                         \
+    for (i = 0; i + (W) <= len; i += (W))                                               \
+      if ((m = MASK(s + i, bc, cl->n) ^ flip))                                          \
+        return i + (__builtin_ctzll(m) >> (SH));                                        \
+    return i + scan_fwd_scalar(s + i, len - i, cl, in);                                 \
+  }                                                                                     \
+  ATTR static size_t scan_rev_##isa(const char *s, size_t len, const cls_t *cl, int in) { \
+    VT bc[CLS_VEC];                                                                     \
+    uint64_t flip = in ? (FULL) : 0, m;                                                 \
+    size_t j, k;                                                                        \
+    for (k = 0; k < cl->n; ++k)                                                         \
+      bc[k] = SET1(cl->set[k]);                                                         \
+    for (j = len; j >= (W); j -= (W))                                                   \
+      if ((m = MASK(s + j - (W), bc, cl->n) ^ flip))                                    \
+        return len - j + (W) - 1 - ((63 - __builtin_clzll(m)) >> (SH));                 \
+    return len - j + scan_rev_scalar(s, j, cl, in);                                     \
+  }
+
+typedef const char *(*find_fn)(const char *h, size_t hlen, const char *n, size_t nlen);
+
+// needle of at least one byte, hlen may be short
+static const char *find_naive(const char *h, size_t hlen, const char *n, size_t nlen) {
+  const char *end;
+  if (hlen < nlen)
+    return 0;
+  for (end = h + hlen - nlen + 1; h < end && (h = memchr(h, *n, end - h)); ++h)
+    if (!memcmp(h + 1, n + 1, nlen - 1))
+      return h;
+  return 0;
+}
+
+static const char *rfind_naive(const char *h, size_t hlen, const char *n, size_t nlen) {
+  size_t i;
+  if (hlen < nlen)
+    return 0;
+  for (i = hlen - nlen + 1; i--;)
+    if (h[i] == *n && !memcmp(h + i + 1, n + 1, nlen - 1))
+      return h + i;
+  return 0;
+}
+
+/*
+ * First and last byte filter. MASK2 sets bits for block positions where
+ * the first needle byte is at a and the last at b, one bit per byte at
+ * 1 << SH. Only those positions are compared in full. Needs nlen >= 2 and
+ * hlen >= nlen.
+ */
+#define FIND_SCAN(isa, W, SH, VT, SET1, MASK2, ATTR)                                    \
+  ATTR static const char *find_fwd_##isa(const char *h, size_t hlen, const char *n,     \
+                                         size_t nlen) {                                 \
+    VT f = SET1(n[0]), l = SET1(n[nlen - 1]);                                           \
+    uint64_t m;                                                                         \
+    size_t i, j;                                                                        \
+    for (i = 0; hlen - i >= nlen - 1 + (W); i += (W))                                   \
+      for (m = MASK2(h + i, h + i + nlen - 1, f, l); m; m &= m - 1) {                   \
+        j = i + (__builtin_ctzll(m) >> (SH));                                           \
+        if (!memcmp(h + j + 1, n + 1, nlen - 2))                                        \
+          return h + j;                                                                 \
+      }                                                                                 \
+    return find_naive(h + i, hlen - i, n, nlen);                                        \
+  }                                                                                     \
+  ATTR static const char *find_rev_##isa(const char *h, size_t hlen, const char *n,     \
+                                         size_t nlen) {                                 \
+    VT f = SET1(n[0]), l = SET1(n[nlen - 1]);                                           \
+    uint64_t m;                                                                         \
+    size_t top = hlen - nlen + 1, b;                                                    \
+    for (; top >= (W); top -= (W))                                                      \
+      for (m = MASK2(h + top - (W), h + top - (W) + nlen - 1, f, l); m;                 \
+           m &= ~(1ULL << b)) {                                                         \
+        b = 63 - __builtin_clzll(m);                                                    \
+        if (!memcmp(h + top - (W) + (b >> (SH)) + 1, n + 1, nlen - 2))                  \
+          return h + top - (W) + (b >> (SH));                                           \
+      }                                                                                 \
+    return rfind_naive(h, top + nlen - 1, n, nlen);                                     \
+  }
+
+#if defined(__GNUC__) && defined(__SSE2__)
+static inline uint64_t sse2_mask(const char *p, const __m128i *bc, size_t n) {
+  __m128i v = _mm_loadu_si128((const __m128i *)p), acc = _mm_cmpeq_epi8(v, bc[0]);
+  for (size_t k = 1; k < n; ++k)
+    acc = _mm_or_si128(acc, _mm_cmpeq_epi8(v, bc[k]));
+  return (unsigned)_mm_movemask_epi8(acc);
+}
+
+static inline uint64_t sse2_mask2(const char *a, const char *b, __m128i f, __m128i l) {
+  __m128i x = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)a), f);
+  __m128i y = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)b), l);
+  return (unsigned)_mm_movemask_epi8(_mm_and_si128(x, y));
+}
+
+CLS_SCAN(sse2, 16, 0, 0xffffU, __m128i, _mm_set1_epi8, sse2_mask, )
+FIND_SCAN(sse2, 16, 0, __m128i, _mm_set1_epi8, sse2_mask2, )
+#define scan_fwd_base scan_fwd_sse2
+#define scan_rev_base scan_rev_sse2
+#define find_fwd_base find_fwd_sse2
+#define find_rev_base find_rev_sse2
+
+#if defined(__linux__) && defined(__x86_64__)
+#define CLS_AVX2 1
+__attribute__((target("avx2"))) static inline uint64_t avx2_mask(const char *p, const __m256i *bc, size_t n) {
+  __m256i v = _mm256_loadu_si256((const __m256i *)p), acc = _mm256_cmpeq_epi8(v, bc[0]);
+  for (size_t k = 1; k < n; ++k)
+    acc = _mm256_or_si256(acc, _mm256_cmpeq_epi8(v, bc[k]));
+  return (unsigned)_mm256_movemask_epi8(acc);
+}
+
+__attribute__((target("avx2"))) static inline uint64_t avx2_mask2(const char *a, const char *b, __m256i f, __m256i l) {
+  __m256i x = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)a), f);
+  __m256i y = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)b), l);
+  return (unsigned)_mm256_movemask_epi8(_mm256_and_si256(x, y));
+}
+
+CLS_SCAN(avx2, 32, 0, 0xffffffffU, __m256i, _mm256_set1_epi8, avx2_mask, __attribute__((target("avx2"))))
+FIND_SCAN(avx2, 32, 0, __m256i, _mm256_set1_epi8, avx2_mask2, __attribute__((target("avx2"))))
+#endif
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// zero byte test without carries between bytes, exact for every byte
+#define SWAR_L7 ((size_t)-1 / 255 * 0x7f)
+#define SWAR_H8 ((size_t)-1 / 255 * 0x80)
+#define swar_set1(c) ((size_t)-1 / 255 * (uint8_t)(c))
+
+static inline uint64_t swar_mask(const char *p, const size_t *bc, size_t n) {
+  size_t v, x, acc = 0, k;
+  memcpy(&v, p, sizeof(v));
+  for (k = 0; k < n; ++k) {
+    x = v ^ bc[k];
+    acc |= ~(((x & SWAR_L7) + SWAR_L7) | x);
+  }
+  return acc & SWAR_H8;
+}
+
+CLS_SCAN(swar, sizeof(size_t), 3, SWAR_H8, size_t, swar_set1, swar_mask, )
+#define scan_fwd_base scan_fwd_swar
+#define scan_rev_base scan_rev_swar
+#else
+#define scan_fwd_base scan_fwd_scalar
+#define scan_rev_base scan_rev_scalar
+#endif
+#ifndef find_fwd_base
+/*
+ * Horspool for targets without vector compares. Shifts are kept in bytes,
+ * needles over 255 bytes shift at most 255, which is never too far.
+ */
+static const char *find_horspool(const char *h, size_t hlen, const char *n, size_t nlen) {
+  uint8_t skip[256];
+  size_t i, last = nlen - 1;
+  if (nlen < 4 || hlen - nlen < 256)
+    return find_naive(h, hlen, n, nlen);
+  memset(skip, nlen > 255 ? 255 : (int)nlen, sizeof(skip));
+  for (i = nlen > 255 ? nlen - 255 : 0; i < last; ++i)
+    skip[(uint8_t)n[i]] = (uint8_t)(last - i);
+  for (i = 0; hlen - i >= nlen; i += skip[(uint8_t)h[i + last]])
+    if (h[i + last] == n[last] && !memcmp(h + i, n, last))
+      return h + i;
+  return 0;
+}
+
+#define find_fwd_base find_horspool
+#define find_rev_base rfind_naive
+#endif
+
+
+#ifdef CLS_AVX2
+static size_t scan_fwd_init(const char *s, size_t len, const cls_t *cl, int in);
+static size_t scan_rev_init(const char *s, size_t len, const cls_t *cl, int in);
+static const char *find_fwd_init(const char *h, size_t hlen, const char *n, size_t nlen);
+static const char *find_rev_init(const char *h, size_t hlen, const char *n, size_t nlen);
+// resolved on first use, racing threads store the same pointers
+static cls_scan_fn scan_fwd = scan_fwd_init, scan_rev = scan_rev_init;
+static find_fn find_fwd = find_fwd_init, find_rev = find_rev_init;
+
+static void scan_select(void) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    scan_fwd = scan_fwd_avx2;
+    scan_rev = scan_rev_avx2;
+    find_fwd = find_fwd_avx2;
+    find_rev = find_rev_avx2;
+  } else {
+    scan_fwd = scan_fwd_base;
+    scan_rev = scan_rev_base;
+    find_fwd = find_fwd_base;
+    find_rev = find_rev_base;
+  }
+}
+
+static size_t scan_fwd_init(const char *s, size_t len, const cls_t *cl, int in) {
+  scan_select();
+  return scan_fwd(s, len, cl, in);
+}
+
+static size_t scan_rev_init(const char *s, size_t len, const cls_t *cl, int in) {
+  scan_select();
+  return scan_rev(s, len, cl, in);
+}
+
+static const char *find_fwd_init(const char *h, size_t hlen, const char *n, size_t nlen) {
+  scan_select();
+  return find_fwd(h, hlen, n, nlen);
+}
+
+static const char *find_rev_init(const char *h, size_t hlen, const char *n, size_t nlen) {
+  scan_select();
+  return find_rev(h, hlen, n, nlen);
+}
+#else
+#define scan_fwd scan_fwd_base
+#define scan_rev scan_rev_base
+#define find_fwd find_fwd_base
+#define find_rev find_rev_base
+#endif
+
+/* runs shorter than this, like the line end of a trim, end before the
+ * kernel setup pays off */
+#define CLS_HEAD 16
+
+static inline size_t cls_scan(const char *s, size_t len, const cls_t *cl, int in, int rev) {
+  size_t k = len < CLS_HEAD ? len : CLS_HEAD, r;
+  if (!cl->n)
+    return in ? 0 : len;
+  if (cl->n > CLS_VEC)
+    k = len;
+  if (rev) {
+    if ((r = scan_rev_scalar(s + len - k, k, cl, in)) < k || k == len)
+      return r;
+    return k + scan_rev(s, len - k, cl, in);
+  }
+  if ((r = scan_fwd_scalar(s, k, cl, in)) < k || k == len)
+    return r;
+  return k + scan_fwd(s + k, len - k, cl, in);
+}
+
+size_t strbf_span(const char *s, size_t len, const char *set) {
+  cls_t cl;
+  assert((s || !len) && set);
+  cls_init(&cl, set);
+  return cls_scan(s, len, &cl, 1, 0);
+}
+
+size_t strbf_cspan(const char *s, size_t len, const char *set) {
+  cls_t cl;
+  assert((s || !len) && set);
+  cls_init(&cl, set);
+  return cls_scan(s, len, &cl, 0, 0);
+}
+
+size_t strbf_rspan(const char *s, size_t len, const char *set) {
+  cls_t cl;
+  assert((s || !len) && set);
+  cls_init(&cl, set);
+  return cls_scan(s, len, &cl, 1, 1);
+}
+
+// ends are tested first, most lines have nothing to trim
+static void trim_cls(SB *sb, const cls_t *cl) {
+  size_t n;
+  sb_flat(sb);
+  sb_edit(sb);
+  if (sb->cur > sb->start && cls_has(cl, sb->cur[-1]))
+    sb->cur -= cls_scan(sb->start, sb->cur - sb->start, cl, 1, 1);
+  if (sb->cur > sb->start && cls_has(cl, *sb->start)) {
+    n = cls_scan(sb->start, sb->cur - sb->start, cl, 1, 0);
+    memmove(sb->start, sb->start + n, sb->cur - sb->start - n);
+    sb->cur -= n;
+  }
+}
+
+void strbf_trim_set(SB *sb, const char *set) {
+  assert(sb && sb->start && set);
+  cls_t cl;
+  cls_init(&cl, set);
+  trim_cls(sb, &cl);
+}
+
 void strbf_trim(SB *sb) {
+  // ' ' '\t' '\r' '\n'
+  static const cls_t spacing = {{1U << '\t' | 1U << '\n' | 1U << '\r', 1U << (' ' - 32)}, " \t\r\n", 4};
+  size_t len, n;
   assert(sb && sb->start);
-  if (sb->start) {
-    // Right trim
-    while (sb->cur>sb->start && is_spacing((sb->cur - 1))) {
-      --sb->cur;
-    }
-    // Left trim
-    if (sb->start && is_spacing(sb->start)) {
-      int i;
-      for (i = 0; is_spacing((sb->start + i)); i++)
-        ;
-      memmove(sb->start, sb->start + i, sb->cur - sb->start - i);
-      sb->cur -= i;
+  sb_flat(sb);
+  sb_edit(sb);
+  // line ends and indents are short, the kernels take what is left
+  len = sb->cur - sb->start;
+  for (n = 0; n < len && n < CLS_HEAD && is_spacing(sb->cur - 1 - n); ++n)
+    ;
+  if (n == CLS_HEAD)
+    n += cls_scan(sb->start, len - n, &spacing, 1, 1);
+  sb->cur -= n;
+  len -= n;
+  for (n = 0; n < len && n < CLS_HEAD && is_spacing(sb->start + n); ++n)
+    ;
+  if (n == CLS_HEAD)
+    n += cls_scan(sb->start + n, len - n, &spacing, 1, 0);
+  if (n) {
+    memmove(sb->start, sb->start + n, len - n);
+    sb->cur -= n;
+  }
+}
+
+/*
+    search and replace
+*/
+
+static const char *mem_find(const char *h, size_t hlen, const char *n, size_t nlen) {
+  if (nlen > hlen)
+    return 0;
+  if (nlen == 1)
+    return memchr(h, *n, hlen);
+  return find_fwd(h, hlen, n, nlen);
+}
+
+static const char *mem_rfind(const char *h, size_t hlen, const char *n, size_t nlen) {
+  if (nlen > hlen)
+    return 0;
+  if (nlen == 1)
+    return rfind_naive(h, hlen, n, 1);
+  return find_rev(h, hlen, n, nlen);
+}
+
+size_t strbf_find(SB *sb, const char *needle, size_t from) {
+  assert(sb && sb->start && needle);
+  size_t len, nlen = strlen(needle);
+  const char *p;
+  sb_flat(sb);
+  len = sb->cur - sb->start;
+  if (from > len)
+    return STRBF_NPOS;
+  if (!nlen)
+    return from;
+  p = mem_find(sb->start + from, len - from, needle, nlen);
+  return p ? (size_t)(p - sb->start) : STRBF_NPOS;
+}
+
+size_t strbf_rfind(SB *sb, const char *needle, size_t from) {
+  assert(sb && sb->start && needle);
+  size_t len, nlen = strlen(needle);
+  const char *p;
+  sb_flat(sb);
+  len = sb->cur - sb->start;
+  if (nlen > len)
+    return STRBF_NPOS;
+  if (from > len - nlen)
+    from = len - nlen;
+  p = nlen ? mem_rfind(sb->start, from + nlen, needle, nlen) : sb->start + from;
+  return p ? (size_t)(p - sb->start) : STRBF_NPOS;
+}
+
+static size_t count_matches(const char *p, const char *end, const char *needle, size_t nlen) {
+  size_t n = 0;
+  for (; (p = mem_find(p, end - p, needle, nlen)); p += nlen)
+    ++n;
+  return n;
+}
+
+size_t strbf_count(SB *sb, const char *needle) {
+  assert(sb && sb->start && needle);
+  size_t nlen = strlen(needle);
+  sb_flat(sb);
+  return nlen ? count_matches(sb->start, sb->cur, needle, nlen) : 0;
+}
+
+/*
+ * Copies from r to w, replacing every match up to end. Writing never
+ * passes reading: w == r when the replacement is not shorter, otherwise
+ * w starts below r by at least the growth of all matches.
+ */
+static char *replace_run(char *w, const char *r, const char *end, const char *needle, size_t nlen,
+                         const char *repl, size_t rlen, size_t *count) {
+  const char *p;
+  for (; (p = mem_find(r, end - r, needle, nlen)); r = p + nlen, ++*count) {
+    if (w != r)
+      memmove(w, r, p - r);
+    w += p - r;
+    memcpy(w, repl, rlen);
+    w += rlen;
+  }
+  if (w != r)
+    memmove(w, r, end - r);
+  return w + (end - r);
+}
+
+size_t strbf_replace_all(SB *sb, const char *needle, const char *repl) {
+  assert(sb && sb->start && needle && repl);
+  size_t nlen = strlen(needle), rlen = strlen(repl), count = 0, len, extra;
+  sb_flat(sb);
+  sb_edit(sb);
+  if (!nlen)
+    return 0;
+  if (rlen > nlen) {
+    // size once, then slide the content up by the growth and rewrite it
+    // from the bottom in one pass
+    if (!(count = count_matches(sb->start, sb->cur, needle, nlen)))
+      return 0;
+    len = sb->cur - sb->start;
+    if (rlen - nlen > (STRBF_NPOS - len) / count)
+      return STRBF_NPOS;
+    extra = count * (rlen - nlen);
+    if (sb->flags & (STRBF_F_ROPE | STRBF_F_SINK) ? (size_t)(sb->end - sb->cur) < extra : !sb_need(sb, extra))
+      return STRBF_NPOS;
+    memmove(sb->start + extra, sb->start, len);
+    count = 0;
+    sb->cur = replace_run(sb->start, sb->start + extra, sb->start + extra + len, needle, nlen, repl, rlen, &count);
+  } else {
+    sb->cur = replace_run(sb->start, sb->start, sb->cur, needle, nlen, repl, rlen, &count);
+  }
+  return count;
+}
+
+/*
+    percent-encoding
+*/
+
+#define URI_UNRES(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || ((c) >= '0' && (c) <= '9') || \
+                      (c) == '-' || (c) == '.' || (c) == '_' || (c) == '~')
+#define URI_SUB(c) ((c) == '!' || (c) == '$' || (c) == '&' || (c) == '\'' || (c) == '(' || (c) == ')' || \
+                    (c) == '*' || (c) == '+' || (c) == ',' || (c) == ';' || (c) == '=')
+#define URI_PCHAR(c) (URI_UNRES(c) || URI_SUB(c) || (c) == ':' || (c) == '@')
+#define URI_QCHAR(c) ((URI_PCHAR(c) || (c) == '/' || (c) == '?') && (c) != '&' && (c) != '=' && (c) != '+')
+#define URI_HEX(c) (((c) >= '0' && (c) <= '9') || ((c) >= 'a' && (c) <= 'f') || ((c) >= 'A' && (c) <= 'F'))
+#define URI_HEXBIT 4
+#define URI_ENTRY(c) (URI_UNRES(c) << STRBF_URI_COMPONENT | URI_PCHAR(c) << STRBF_URI_SEGMENT | \
+                      (URI_PCHAR(c) || (c) == '/') << STRBF_URI_PATH | URI_QCHAR(c) << STRBF_URI_QUERY | \
+                      URI_HEX(c) << URI_HEXBIT)
+#define URI_ROW(n) URI_ENTRY(n), URI_ENTRY(n + 1), URI_ENTRY(n + 2), URI_ENTRY(n + 3), URI_ENTRY(n + 4), \
+    URI_ENTRY(n + 5), URI_ENTRY(n + 6), URI_ENTRY(n + 7), URI_ENTRY(n + 8), URI_ENTRY(n + 9), URI_ENTRY(n + 10), \
+    URI_ENTRY(n + 11), URI_ENTRY(n + 12), URI_ENTRY(n + 13), URI_ENTRY(n + 14), URI_ENTRY(n + 15)
+
+// bit STRBF_URI_* set when the byte stays as is in that class
+static const uint8_t uri_class[256] = {
+    URI_ROW(0x00), URI_ROW(0x10), URI_ROW(0x20), URI_ROW(0x30), URI_ROW(0x40), URI_ROW(0x50), URI_ROW(0x60), URI_ROW(0x70),
+    URI_ROW(0x80), URI_ROW(0x90), URI_ROW(0xa0), URI_ROW(0xb0), URI_ROW(0xc0), URI_ROW(0xd0), URI_ROW(0xe0), URI_ROW(0xf0),
+};
+
+#define uri_hexval(c) (((c) & 0xf) + ((c) >> 6) * 9)
+
+// leading run of unreserved bytes, kept as is in every class
+static size_t uri_run(const char *s, size_t len) {
+  size_t i = 0;
+#if defined(__GNUC__) && defined(__SSE2__)
+  // signed compares, bytes from 0x80 are negative and fall out of every range
+#define in_range(v, lo, hi) _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((lo) - 1)), _mm_cmpgt_epi8(_mm_set1_epi8((hi) + 1), v))
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i)), m;
+    m = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    m = _mm_or_si128(m, in_range(v, '0', '9'));
+    m = _mm_or_si128(m, in_range(v, '-', '.'));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+    unsigned bad = ~_mm_movemask_epi8(m) & 0xffff;
+    if (bad)
+      return i + __builtin_ctz(bad);
+  }
+#undef in_range
+#endif
+  while (i < len && uri_class[(uint8_t)s[i]] & 1 << STRBF_URI_COMPONENT)
+    ++i;
+  return i;
+}
+
+#define URI_PIECE 64 // input bytes escaped on the stack when a sink is too small
+
+// escape len bytes of str to p, at most 3 * len bytes, returns the end
+static char *uri_escape(char *p, const char *str, size_t len, uint8_t bit) {
+  static const char hex[] = "0123456789ABCDEF";
+  size_t i = 0, n;
+  uint8_t c;
+  while (i < len) {
+    n = uri_run(str + i, len - i);
+    memcpy(p, str + i, n);
+    p += n;
+    // bytes up to the next unreserved one take the table
+    for (i += n; i < len && !(uri_class[c = (uint8_t)str[i]] & 1 << STRBF_URI_COMPONENT); ++i) {
+      if (uri_class[c] & bit) {
+        *p++ = c;
+      } else {
+        p[0] = '%';
+        p[1] = hex[c >> 4];
+        p[2] = hex[c & 0xf];
+        p += 3;
+      }
     }
   }
+  return p;
 }
 
-char *strbf_finish(const SB *sb) {
+int strbf_put_uri_escaped(SB *sb, const char *str, size_t len, int cls) {
+  assert(sb && sb->start && cls >= STRBF_URI_COMPONENT && cls <= STRBF_URI_QUERY);
+  const uint8_t bit = 1 << cls;
+  char t[3 * URI_PIECE];
+  size_t n;
+  if (!str)
+    return 0;
+  if (!len)
+    len = strlen(str);
+  if (len > STRBF_NPOS / 3)
+    return -1;
+  if (sb_need(sb, 3 * len)) {
+    sb->cur = uri_escape(sb->cur, str, len, bit);
+    return 0;
+  }
+  // more than a sink holds, escaped in pieces and passed on as they fit
+  if (!(sb->flags & STRBF_F_SINK))
+    return -1;
+  for (; len; str += n, len -= n) {
+    n = len < URI_PIECE ? len : URI_PIECE;
+    if (strbf_put(sb, t, uri_escape(t, str, n, bit) - t))
+      return -1;
+  }
+  return 0;
+}
+
+int strbf_uri_decode_inplace(SB *sb, size_t from, int plus) {
   assert(sb && sb->start);
+  char *r, *w, *end;
+  cls_t cl;
+  size_t n;
+  int ret = 0;
+  sb_flat(sb);
+  sb_edit(sb);
+  assert(from <= (size_t)(sb->cur - sb->start));
+  cls_init(&cl, plus ? "%+" : "%");
+  r = w = sb->start + from;
+  end = sb->cur;
+  while (r < end) {
+    n = cls_scan(r, end - r, &cl, 0, 0);
+    if (w != r)
+      memmove(w, r, n);
+    w += n;
+    r += n;
+    if (r == end)
+      break;
+    if (*r == '+') {
+      *w++ = ' ';
+      ++r;
+    } else if (end - r >= 3 && uri_class[(uint8_t)r[1]] & uri_class[(uint8_t)r[2]] & 1 << URI_HEXBIT) {
+      *w++ = (char)(uri_hexval(r[1]) << 4 | uri_hexval(r[2]));
+      r += 3;
+    } else {
+      *w++ = *r++;
+      ret = -1;
+    }
+  }
+  sb->cur = w;
+  return ret;
+}
+
+/*
+    columnar CSV, rows from column arrays
+*/
+
+#define CSV_BLOCK 64  // rows per block
+#define CSV_SLOTS 256 // staged integer fields per block
+#define CSV_SLACK 16  // fields are copied 16 bytes at a time
+#define CSV_WIDE 320  // floats from 1e19 up print every integer digit
+
+// worst-case field width, floats below 1e19
+static size_t csv_width(const strbf_csv_col_t *c) {
+  if (c->type == STRBF_CSV_F32 || c->type == STRBF_CSV_F64)
+    return 1 + 20 + 1 + c->prec;
+  return 1 + 10 + (c->prec > 0);
+}
+
+// floats in rows r..r+k that need more than csv_width, NaN and Inf print short
+static size_t csv_wide(const strbf_csv_col_t *cols, size_t ncols, size_t r, size_t k) {
+  size_t n = 0;
+  for (size_t c = 0; c < ncols; ++c) {
+    if (cols[c].type == STRBF_CSV_F32) {
+      const float *v = (const float *)cols[c].data + r;
+      for (size_t i = 0; i < k; ++i)
+        n += fabsf(v[i]) >= 1e19f && isfinite(v[i]);
+    } else if (cols[c].type == STRBF_CSV_F64) {
+      const double *v = (const double *)cols[c].data + r;
+      for (size_t i = 0; i < k; ++i)
+        n += fabs(v[i]) >= 1e19 && isfinite(v[i]);
+    }
+  }
+  return n;
+}
+
+#if defined(__GNUC__) && defined(__SSE2__)
+/*
+ * Integer columns are staged a block at a time, 4 or 8 rows per vector.
+ * Lanes are split into 10^8 and 10^4 parts by multiplication, the 4
+ * digit groups of all rows are then cut into digit planes on 16-bit
+ * lanes and interleaved back into one 16 digit field per row, zero
+ * padded. With a fraction the integer digits move one byte down to make
+ * room for the point. The field ends a 32 byte slot, len counts from the
+ * end and includes the sign, rows copy 16 bytes and may read into the
+ * next slot.
+ */
+#define CSV_STAGE 1
+
+// zeros is the movemask of '0' bytes, the sign goes before the first digit
+// kept and only counts for negative values
+static inline uint8_t csv_len(char *s, unsigned zeros, unsigned neg, unsigned prec) {
+  unsigned at = __builtin_ctz(~zeros | 1U << (15 - prec)) - (prec > 0);
+  s[16 + at - 1] = '-';
+  return (uint8_t)(16 - at + neg);
+}
+
+// bytes before the point, the point and bytes after it
+static const uint8_t csv_dot[10][3][16] = {
+#define CSV_DOT_MASK(p, k) {CSV_DOT_B(p, k, 0), CSV_DOT_B(p, k, 1), CSV_DOT_B(p, k, 2), CSV_DOT_B(p, k, 3),       \
+                            CSV_DOT_B(p, k, 4), CSV_DOT_B(p, k, 5), CSV_DOT_B(p, k, 6), CSV_DOT_B(p, k, 7),       \
+                            CSV_DOT_B(p, k, 8), CSV_DOT_B(p, k, 9), CSV_DOT_B(p, k, 10), CSV_DOT_B(p, k, 11),     \
+                            CSV_DOT_B(p, k, 12), CSV_DOT_B(p, k, 13), CSV_DOT_B(p, k, 14), CSV_DOT_B(p, k, 15)}
+#define CSV_DOT_B(p, k, j) ((k) == 0 ? ((j) < 15 - (p) ? 0xff : 0) : (k) == 1 ? ((j) == 15 - (p) ? '.' : 0) \
+                                                                   : ((j) > 15 - (p) ? 0xff : 0))
+#define CSV_DOT(p) {CSV_DOT_MASK(p, 0), CSV_DOT_MASK(p, 1), CSV_DOT_MASK(p, 2)}
+    {{0}}, CSV_DOT(1), CSV_DOT(2), CSV_DOT(3), CSV_DOT(4), CSV_DOT(5), CSV_DOT(6), CSV_DOT(7), CSV_DOT(8), CSV_DOT(9),
+#undef CSV_DOT
+#undef CSV_DOT_B
+#undef CSV_DOT_MASK
+};
+
+/*
+ * 16 digit fields of the unsigned lanes of m into r[0..3], r[j] holds row
+ * j and in the high half of 256-bit vectors row j + 4. Quotients are
+ * (v * 0x55e63b89) >> 57 = v / 10^8 and (v * 0xd1b71759) >> 45 = v / 10^4,
+ * even and odd lanes multiplied separately.
+ */
+#define CSV_FIELDS(T, P, B, m, r)                                                                      \
+  do {                                                                                                 \
+    T c8_ = P##_set1_epi32(0x55e63b89), c4_ = P##_set1_epi32((int)0xd1b71759);                         \
+    T e_ = P##_srli_epi64(P##_mul_epu32(m, c8_), 57);                                                  \
+    T o_ = P##_srli_epi64(P##_mul_epu32(P##_srli_epi64(m, 32), c8_), 57);                              \
+    T h_ = P##_or_si##B(e_, P##_slli_epi64(o_, 32)), l_, a_, g_, q3_, q2_, q1_, w32_, w10_, u_;        \
+    l_ = P##_sub_epi32(m, P##_or_si##B(P##_mul_epu32(e_, P##_set1_epi32(100000000)),                   \
+                                       P##_slli_epi64(P##_mul_epu32(o_, P##_set1_epi32(100000000)), 32))); \
+    e_ = P##_srli_epi64(P##_mul_epu32(l_, c4_), 45);                                                   \
+    o_ = P##_srli_epi64(P##_mul_epu32(P##_srli_epi64(l_, 32), c4_), 45);                               \
+    a_ = P##_or_si##B(e_, P##_slli_epi64(o_, 32));                                                     \
+    g_ = P##_packs_epi32(a_, P##_sub_epi32(l_, P##_madd_epi16(a_, P##_set1_epi32(10000))));            \
+    a_ = P##_slli_epi16(g_, 2);                                                                        \
+    q3_ = P##_mulhi_epu16(P##_mulhi_epu16(a_, P##_set1_epi16(8389)), P##_set1_epi16(1 << 7));          \
+    q2_ = P##_mulhi_epu16(P##_mulhi_epu16(a_, P##_set1_epi16(5243)), P##_set1_epi16(1 << 11));         \
+    q1_ = P##_mulhi_epu16(P##_mulhi_epu16(a_, P##_set1_epi16(13108)), P##_set1_epi16(1 << 13));        \
+    a_ = P##_set1_epi16(10);                                                                           \
+    w32_ = P##_or_si##B(q3_, P##_slli_epi16(P##_sub_epi16(q2_, P##_mullo_epi16(q3_, a_)), 8));         \
+    w10_ = P##_or_si##B(P##_sub_epi16(q1_, P##_mullo_epi16(q2_, a_)),                                  \
+                        P##_slli_epi16(P##_sub_epi16(g_, P##_mullo_epi16(q1_, a_)), 8));               \
+    g_ = P##_unpacklo_epi16(w32_, w10_);                                                               \
+    q1_ = P##_unpackhi_epi16(w32_, w10_);                                                              \
+    a_ = P##_set1_epi8('0');                                                                           \
+    l_ = P##_add_epi8(P##_unpacklo_epi32(g_, q1_), a_);                                                \
+    q2_ = P##_add_epi8(P##_unpackhi_epi32(g_, q1_), a_);                                               \
+    /* digits above 10^8, h < 43 so (h * 205) >> 11 is h / 10 */                                       \
+    e_ = P##_srli_epi32(P##_mullo_epi16(h_, P##_set1_epi32(205)), 11);                                 \
+    u_ = P##_sub_epi32(h_, P##_madd_epi16(e_, P##_set1_epi32(10)));                                    \
+    h_ = P##_add_epi32(P##_or_si##B(P##_slli_epi32(e_, 16), P##_slli_epi32(u_, 24)), a_);             \
+    e_ = P##_unpacklo_epi32(a_, h_);                                                                   \
+    o_ = P##_unpackhi_epi32(a_, h_);                                                                   \
+    r[0] = P##_unpacklo_epi64(e_, l_);                                                                 \
+    r[1] = P##_unpackhi_epi64(e_, l_);                                                                 \
+    r[2] = P##_unpacklo_epi64(o_, q2_);                                                                \
+    r[3] = P##_unpackhi_epi64(o_, q2_);                                                                \
+  } while (0)
+
+// four rows per step, slots up to k rounded to 4 are written
+static void csv_stage_sse2(char *st, uint8_t *len, const void *data, int sign, unsigned prec, size_t k) {
+  const __m128i *dm = (const __m128i *)csv_dot[prec];
+  __m128i lo = _mm_loadu_si128(dm), dot = _mm_loadu_si128(dm + 1), hi = _mm_loadu_si128(dm + 2);
+  __m128i zero = _mm_set1_epi8('0'), r[4];
+  uint32_t tail[4];
+  for (size_t i = 0; i < k; i += 4, st += 128) {
+    const void *src = (const uint32_t *)data + i;
+    if (k - i < 4) {
+      memset(tail, 0, sizeof(tail));
+      src = memcpy(tail, src, (k - i) * 4);
+    }
+    __m128i m = _mm_loadu_si128((const __m128i *)src);
+    unsigned neg = 0;
+    if (sign) {
+      __m128i s = _mm_srai_epi32(m, 31);
+      neg = _mm_movemask_ps(_mm_castsi128_ps(m));
+      m = _mm_sub_epi32(_mm_xor_si128(m, s), s);
+    }
+    CSV_FIELDS(__m128i, _mm, 128, m, r);
+#define CSV_ROW(j)                                                                           \
+  do {                                                                                       \
+    unsigned z = _mm_movemask_epi8(_mm_cmpeq_epi8(r[j], zero));                              \
+    if (prec)                                                                                \
+      r[j] = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_si128(r[j], 1), lo), dot),     \
+                          _mm_and_si128(r[j], hi));                                          \
+    _mm_storeu_si128((__m128i *)(st + 32 * j + 16), r[j]);                                   \
+    len[i + j] = csv_len(st + 32 * j, z, neg >> j & 1, prec);                                \
+  } while (0)
+    CSV_ROW(0);
+    CSV_ROW(1);
+    CSV_ROW(2);
+    CSV_ROW(3);
+#undef CSV_ROW
+  }
+}
+
+#ifdef CLS_AVX2
+// eight rows per step, the low lane holds rows i..i + 3
+__attribute__((target("avx2"))) static void csv_stage_avx2(char *st, uint8_t *len, const void *data, int sign,
+                                                            unsigned prec, size_t k) {
+  const __m128i *dm = (const __m128i *)csv_dot[prec];
+  __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128(dm));
+  __m256i dot = _mm256_broadcastsi128_si256(_mm_loadu_si128(dm + 1));
+  __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128(dm + 2));
+  __m256i zero = _mm256_set1_epi8('0'), r[4];
+  uint32_t tail[8];
+  for (size_t i = 0; i < k; i += 8, st += 256) {
+    const void *src = (const uint32_t *)data + i;
+    if (k - i < 8) {
+      memset(tail, 0, sizeof(tail));
+      src = memcpy(tail, src, (k - i) * 4);
+    }
+    __m256i m = _mm256_loadu_si256((const __m256i *)src);
+    unsigned neg = 0;
+    if (sign) {
+      __m256i s = _mm256_srai_epi32(m, 31);
+      neg = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+      m = _mm256_sub_epi32(_mm256_xor_si256(m, s), s);
+    }
+    CSV_FIELDS(__m256i, _mm256, 256, m, r);
+#define CSV_ROW(j)                                                                                     \
+  do {                                                                                                 \
+    unsigned z = _mm256_movemask_epi8(_mm256_cmpeq_epi8(r[j], zero));                                  \
+    if (prec)                                                                                          \
+      r[j] = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_bsrli_epi128(r[j], 1), lo), dot), \
+                             _mm256_and_si256(r[j], hi));                                              \
+    _mm_storeu_si128((__m128i *)(st + 32 * j + 16), _mm256_castsi256_si128(r[j]));                    \
+    _mm_storeu_si128((__m128i *)(st + 32 * j + 144), _mm256_extracti128_si256(r[j], 1));              \
+    len[i + j] = csv_len(st + 32 * j, z & 0xffff, neg >> j & 1, prec);                                 \
+    len[i + j + 4] = csv_len(st + 32 * j + 128, z >> 16, neg >> (j + 4) & 1, prec);                    \
+  } while (0)
+    CSV_ROW(0);
+    CSV_ROW(1);
+    CSV_ROW(2);
+    CSV_ROW(3);
+#undef CSV_ROW
+  }
+}
+
+typedef void (*csv_stage_fn)(char *st, uint8_t *len, const void *data, int sign, unsigned prec, size_t k);
+static void csv_stage_init(char *st, uint8_t *len, const void *data, int sign, unsigned prec, size_t k);
+// resolved on first use like scan_fwd
+static csv_stage_fn csv_stage = csv_stage_init;
+
+static void csv_stage_init(char *st, uint8_t *len, const void *data, int sign, unsigned prec, size_t k) {
+  __builtin_cpu_init();
+  csv_stage = __builtin_cpu_supports("avx2") ? csv_stage_avx2 : csv_stage_sse2;
+  csv_stage(st, len, data, sign, prec, k);
+}
+#else
+#define csv_stage csv_stage_sse2
+#endif
+#endif
+
+int strbf_put_csv(SB *sb, const strbf_csv_col_t *cols, size_t ncols, char sep, size_t from, size_t to) {
+  assert(sb && sb->start && cols && ncols && ncols <= STRBF_CSV_MAX_COLS && from <= to);
+  size_t row = ncols, blk = CSV_BLOCK, r, k, c, i;
+  for (c = 0; c < ncols; ++c) {
+    assert(cols[c].type <= STRBF_CSV_F64 && cols[c].prec <= 9);
+    row += csv_width(cols + c);
+  }
+#ifdef CSV_STAGE
+  char st[CSV_SLOTS * 32 + CSV_SLACK];
+  uint8_t len[CSV_SLOTS];
+  uint8_t slot[STRBF_CSV_MAX_COLS];
+  size_t nint = 0;
+  for (c = 0; c < ncols; ++c)
+    if (cols[c].type <= STRBF_CSV_U32)
+      slot[c] = nint++;
+  if (nint && CSV_SLOTS / nint < blk)
+    blk = CSV_SLOTS / nint & ~(size_t)7;
+#endif
+  if (from == to)
+    return 0;
+  // one growth for the whole range, rope chunks and sinks stay bounded and
+  // go block by block
+  if (!(sb->flags & (STRBF_F_ROPE | STRBF_F_SINK)) &&
+      !sb_need(sb, (to - from) * row + csv_wide(cols, ncols, from, to - from) * CSV_WIDE + CSV_SLACK))
+    return -1;
+  for (r = from; r < to; r += k) {
+    k = to - r < blk ? to - r : blk;
+    // a sink flushes and may still be too small, halve until a block fits
+    while (!sb_need(sb, k * row + csv_wide(cols, ncols, r, k) * CSV_WIDE + CSV_SLACK))
+      if (k == 1 || !(k /= 2))
+        return -1;
+    char *p = sb->cur;
+#ifdef CSV_STAGE
+    // kernels fill slots up to k rounded to 8
+    size_t kpad = (k + 7) & ~(size_t)7;
+    for (c = 0; c < ncols; ++c)
+      if (cols[c].type <= STRBF_CSV_U32)
+        csv_stage(st + slot[c] * kpad * 32, len + slot[c] * kpad, (const char *)cols[c].data + r * 4,
+                  cols[c].type == STRBF_CSV_I32, cols[c].prec, k);
+#endif
+    for (i = 0; i < k; ++i) {
+      for (c = 0; c < ncols; ++c) {
+        const strbf_csv_col_t *col = cols + c;
+        switch (col->type) {
+        case STRBF_CSV_I32:
+        case STRBF_CSV_U32: {
+#ifdef CSV_STAGE
+          size_t at = slot[c] * kpad + i;
+          memcpy(p, st + at * 32 + 32 - len[at], 16);
+          p += len[at];
+#else
+          if (col->type == STRBF_CSV_I32)
+            p += fix_to_char(((const int32_t *)col->data)[r + i], col->prec, p);
+          else
+            p += ufix_to_char(((const uint32_t *)col->data)[r + i], col->prec, p);
+#endif
+          break;
+        }
+        case STRBF_CSV_F32:
+          p += f_to_char(((const float *)col->data)[r + i], p, col->prec);
+          break;
+        default:
+          p += f_to_char(((const double *)col->data)[r + i], p, col->prec);
+          break;
+        }
+        *p++ = sep;
+      }
+      p[-1] = '\n';
+    }
+    sb->cur = p;
+  }
+  return 0;
+}
+
+char *strbf_finish(SB *sb) {
+  assert(sb && sb->start);
+  sb_flat(sb);
   *sb->cur = 0;
   assert(sb->start <= sb->cur && strlen(sb->start) == (size_t)(sb->cur - sb->start));
   return sb->start;
@@ -481,25 +2573,36 @@ char *strbf_finish_url(SB *sb) {
   return strbf_finish(sb);
 }
 
-char *strbf_get(const SB *sb) {
+char *strbf_get(SB *sb) {
   assert(sb && sb->start);
+  sb_flat(sb);
   return sb->start;
 }
 
 size_t strbf_len(SB *sb) {
   assert(sb && sb->start);
+  if (sb->flags & STRBF_F_GAP)
+    return sb->cur - sb->start - ((strbf_gap_t *)sb)->gap_len;
   return sb->cur - sb->start;
 }
 
 char *strbf_cur(SB *sb) {
   assert(sb && sb->start);
+  sb_flat(sb);
   return sb->cur;
 }
 
 void strbf_free(SB *sb) {
   if(!sb || sb->max) return;
-  if (sb->start) {
-    free(sb->start);
+  if (sb->flags & STRBF_F_GAP) {
+    strbf_gap_t *g = (strbf_gap_t *)sb;
+    if (g->base)
+      sb->alloc->free(sb->alloc->ctx, g->base, sb->end - g->base + 1);
+    g->base = g->gap = 0;
+    g->gap_len = 0;
+    sb->start = 0;
+  } else if (sb->start) {
+    sb->alloc->free(sb->alloc->ctx, sb->start, sb->end - sb->start + 1);
     sb->start = 0;
   }
   sb->cur = 0;